@@ -6,6 +6,8 @@ COMPRESSOR=./compressor_main.cpp
 COMPRESSOR_NAME=./exec_linux/compressor
 DECOMPRESSOR=./decompressor_main.cpp
 DECOMPRESSOR_NAME=./exec_linux/decompressor
+ALLOCATION_TEST=./tests/objective_allocations.cpp
+ALLOCATION_TEST_NAME=./exec_linux/objective_allocations
 
 g++ $CPP_FLAGS $SRC_DIR $COMPRESSOR -o $COMPRESSOR_NAME > compressor_compile.log 2>&1
 
@@ -23,4 +25,12 @@ if [ $? -eq 0 ]; then
 else
     echo Decompressor compilation failed.
     exit 1
-fi
\ No newline at end of file
+fi
+g++ $CPP_FLAGS $SRC_DIR $ALLOCATION_TEST -o $ALLOCATION_TEST_NAME > allocation_test_compile.log 2>&1
+
+if [ $? -eq 0 ]; then
+    echo Allocation test compilation done.
+else
+    echo Allocation test compilation failed.
+    exit 1
+fi
@@ -7,6 +7,8 @@
 #include <filesystem>
 #include <string>
 #include <functional>
+#include <chrono>
+#include <memory>
 
 struct OptSetting{
     size_t max_iteration;
@@ -18,6 +20,17 @@ const std::unordered_map<std::string, bfft::BlaschkeFFT::ResizeType> RESIZE_TYPE
     {"linear-interpolation", bfft::BlaschkeFFT::ResizeType::LINEAR_INTERPOLATION},
 };
 
+const std::unordered_map<std::string, bfft::ChannelType> CHANNEL_TYPES = {
+    {"reuse", bfft::ChannelType::REUSE},
+    {"refine", bfft::ChannelType::REFINE},
+};
+
+const std::unordered_map<std::string, ChromaSubsampling> CHROMA_SUBSAMPLINGS = {
+    {"444", CHROMA_444},
+    {"422", CHROMA_422},
+    {"420", CHROMA_420},
+};
+
 const OptSetting opt_settings[] = {OptSetting{3, 1}, OptSetting{5, 2}, OptSetting{10, 3}, OptSetting{40, 5}};
 
 int main(int argc, char *argv[]){
@@ -28,6 +41,24 @@ int main(int argc, char *argv[]){
     parser.add_argument("-ratio").add<double>([](double x) { return 0.0 < x && x <= 1.0; }).help("Compression ratio (double) in (0, 1], default value (0.5).");
     parser.add_argument("-resize").add<std::string>([](const std::string& s) { return RESIZE_TYPES.contains(s); }).help("Rescaling type {simple|linear-interpolation}.");
     parser.add_argument("-no-opt").help("Turns off optimization.");
+    parser.add_argument("-quasi-newton").help("Optimizes with a quasi-Newton method on the gradient of the truncation error estimate.");
+    parser.add_argument("-proxy").help("Optimizes an error estimate from the dropped coefficients, faster but less exact.");
+    parser.add_argument("-incremental").help("Evaluates the optimized row/column change incrementally instead of the full transform.");
+    parser.add_argument("-hierarchical").help("Refines a coarse sample grid instead of scanning the full one, faster but less exhaustive.");
+    parser.add_argument("-warm-start").help("Encodes the blocks in wavefront order and starts from the parameters of the neighbouring blocks.");
+    parser.add_argument("-spectral-start").help("Starts each parameter from the descent direction of the zero parameter transform instead of a sample grid. Not with -warm-start.");
+    parser.add_argument("-shared-params").help("Optimizes one function system for all rows and one for all columns of a block, faster and smaller, but less adaptive. Not with -quasi-newton or -spectral-start.");
+    parser.add_argument("-channel-reuse").add<std::string>([](const std::string& s) { return CHANNEL_TYPES.contains(s); }).help("Optimizes the first channel and encodes the other channels with its parameters {reuse|refine}, refine searches shortly around them.");
+    parser.add_argument("-speculative").help("Evaluates the candidates of a Nelder-Mead step concurrently on the spare threads.");
+    parser.add_argument("-time-budget").add<int>([](int x) { return 0 < x; }).help("Encodes within about this many milliseconds, the blocks with the largest error are optimized first.");
+    parser.add_argument("-skip-flat").help("Doesn't optimize flat blocks and blocks that are within half a gray level without optimization.");
+    parser.add_argument("-codebook").add<std::string>([](const std::string& path) { return std::filesystem::exists(path); }).help("Encodes the blocks with the best matching entries of this codebook file instead of optimizing them.");
+    parser.add_argument("-train-codebook").add<std::string>().help("Adds the optimized parameters of the image to this codebook file, it is created if it doesn't exist.");
+    parser.add_argument("-codebook-size").add<int>([](int x) { return 0 < x; }).help("Number of codebook entries per block size when training, default value 64.");
+    parser.add_argument("-ycbcr").help("Encodes RGB channels as luma and chroma planes.");
+    parser.add_argument("-chroma").add<std::string>([](const std::string& s) { return CHROMA_SUBSAMPLINGS.contains(s); }).help("Chroma subsampling {444|422|420} of the YCbCr planes, implies -ycbcr.");
+    parser.add_argument("-chroma-ratio").add<double>([](double x) { return 0.0 < x && x <= 1.0; }).help("Compression ratio (double) in (0, 1] of the chroma planes, default is the ratio of the luma, implies -ycbcr.");
+    parser.add_argument("-threads").add<int>([](int x) { return 0 < x; }).help("Number of worker threads encoding the blocks, default is the hardware concurrency.");
     parser.add_argument("-lvl").add<int>([](int x) { return 0 <= x && x <= 3; }).help("Sets optimization level [0-3], default value 3.");
     parser.add_argument("-block").add<int>([](int x) { return 8 <= x && x <= 128; }).help("Block size in [8, 128], default value 16.");
     parser.add_argument("-name").add<std::string>().help("Save file name, location is the same as source, default name is same as source with extension `.bc`.");
@@ -43,10 +74,27 @@ int main(int argc, char *argv[]){
         return 0;
     }
 
+    // the shared systems are always searched with Nelder-Mead from the grid or the neighbours
+    if(parser.used_argument("-shared-params") && (parser.used_argument("-quasi-newton") || parser.used_argument("-spectral-start"))){
+        std::cerr << "-shared-params can't be combined with -quasi-newton or -spectral-start." << std::endl;
+        return 1;
+    }
+
+    // a level has a single kind of starting guess
+    if(parser.used_argument("-warm-start") && parser.used_argument("-spectral-start")){
+        std::cerr << "-warm-start can't be combined with -spectral-start." << std::endl;
+        return 1;
+    }
+
     int channels = 0;
     double ratio = 0.5;
     bfft::BlaschkeFFT::ResizeType resize_type = bfft::BlaschkeFFT::ResizeType::LINEAR_INTERPOLATION;
     bfft::OptimizerOpt optimizer = bfft::OptimizerOpt::NELDER_MEAD;
+    bfft::ObjectiveType objective = bfft::ObjectiveType::EXACT;
+    bfft::EvaluationType evaluation = bfft::EvaluationType::FULL;
+    bfft::GridType grid = bfft::GridType::EXHAUSTIVE;
+    bfft::StepType step = bfft::StepType::SEQUENTIAL;
+    bfft::StartType start = bfft::StartType::GRID;
     size_t lvl = 3;
     size_t block_size = 16;
 
@@ -65,10 +113,38 @@ int main(int argc, char *argv[]){
         resize_type = RESIZE_TYPES.at(parser.get_value<std::string>("-resize"));
     }
 
+    if(parser.used_argument("-quasi-newton")){
+        optimizer = bfft::OptimizerOpt::QUASI_NEWTON;
+    }
+
     if(parser.used_argument("-no-opt")){
         optimizer = bfft::OptimizerOpt::NO_OPTIMIZE;
     }
 
+    if(parser.used_argument("-proxy")){
+        objective = bfft::ObjectiveType::TRANSFORM_PROXY;
+    }
+
+    if(parser.used_argument("-incremental")){
+        evaluation = bfft::EvaluationType::INCREMENTAL;
+    }
+
+    if(parser.used_argument("-hierarchical")){
+        grid = bfft::GridType::HIERARCHICAL;
+    }
+
+    if(parser.used_argument("-warm-start")){
+        start = bfft::StartType::NEIGHBOURS;
+    }
+
+    if(parser.used_argument("-spectral-start")){
+        start = bfft::StartType::SPECTRUM;
+    }
+
+    if(parser.used_argument("-speculative")){
+        step = bfft::StepType::SPECULATIVE;
+    }
+
     if(parser.used_argument("-lvl")){
         lvl = static_cast<size_t>(parser.get_value<int>("-lvl"));
     }
@@ -85,12 +161,69 @@ int main(int argc, char *argv[]){
 
     std::cout << "Start compressing (this may take a while)." << std::endl;
     
-    auto compressed_data = image.compress(ratio, resize_type, optimizer, block_size, opt_settings[lvl].max_iteration, opt_settings[lvl].max_shrink);
+    bfft::OptimizerSettings settings{opt_settings[lvl].max_iteration, opt_settings[lvl].max_shrink, objective, evaluation, grid, step};
+    settings.start = start;
+    if(parser.used_argument("-shared-params")){
+        settings.sharing = bfft::SharingType::SHARED;
+    }
+    if(parser.used_argument("-channel-reuse")){
+        settings.channels = CHANNEL_TYPES.at(parser.get_value<std::string>("-channel-reuse"));
+    }
+    if(parser.used_argument("-skip-flat")){
+        settings.skip_error = 0.5;
+    }
+    if(parser.used_argument("-threads")){
+        settings.threads = static_cast<size_t>(parser.get_value<int>("-threads"));
+    }
+    if(parser.used_argument("-time-budget")){
+        settings.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(parser.get_value<int>("-time-budget"));
+    }
+    std::unique_ptr<bfft::ParameterCodebook> codebook;
+    if(parser.used_argument("-codebook")){
+        codebook = std::make_unique<bfft::ParameterCodebook>(parser.get_value<std::string>("-codebook"));
+    }
+    ColorSettings color;
+    if(parser.used_argument("-ycbcr")){
+        color.ycbcr = true;
+    }
+    if(parser.used_argument("-chroma")){
+        color.ycbcr = true;
+        color.subsampling = CHROMA_SUBSAMPLINGS.at(parser.get_value<std::string>("-chroma"));
+    }
+    if(parser.used_argument("-chroma-ratio")){
+        color.ycbcr = true;
+        color.chroma_ratio = parser.get_value<double>("-chroma-ratio");
+    }
+    std::vector<BlockedData> compressed_data;
+    try{
+        compressed_data = image.compress(ratio, resize_type, optimizer, block_size, settings, codebook.get(), color);
+    } catch(const std::exception& e){
+        std::cerr << "Error while compressing blocks: " << e.what() << std::endl;
+        return 1;
+    }
     
     BinaryFileWriter fwriter(save_path);
     fwriter.write(compressed_data);
     
     std::cout << "Compressing finished." << std::endl;
 
+    if(parser.used_argument("-train-codebook")){
+        std::filesystem::path codebook_path = parser.get_value<std::string>("-train-codebook");
+        size_t codebook_size = parser.used_argument("-codebook-size") ? static_cast<size_t>(parser.get_value<int>("-codebook-size")) : 64;
+        // the entries of an existing codebook are weighted samples, so a codebook can be trained on several images
+        std::vector<bfft::ParameterCodebook::Entry> samples = image.codebook_samples(compressed_data, settings.channels != bfft::ChannelType::SEPARATE && codebook == nullptr);
+        if(std::filesystem::exists(codebook_path)){
+            bfft::ParameterCodebook previous(codebook_path);
+            samples.insert(samples.end(), previous.entries().begin(), previous.entries().end());
+        }
+        bfft::ParameterCodebook::train(samples, codebook_size).save(codebook_path);
+        std::cout << "Codebook trained on " << samples.size() << " samples." << std::endl;
+    }
+
+    auto cache_stats = bfft::objective_cache_stats();
+    if(cache_stats.hits + cache_stats.misses > 0){
+        std::cout << "Objective cache: " << cache_stats.hits << " hits of " << cache_stats.hits + cache_stats.misses << " evaluations." << std::endl;
+    }
+
     return 0;
 }
\ No newline at end of file
@@ -11,6 +11,7 @@ int main(int argc, char *argv[]){
 
     parser.add_argument("source").add<std::string>([](const std::string& path) { try{ return std::filesystem::exists(path); } catch(...) { ERROR(false, "Unable to reach location: " + path); return false; } }).required().help("Source file location.");
     parser.add_argument("-h").special().help("Prints command description.");
+    parser.add_argument("-threads").add<int>([](int x) { return 0 < x; }).help("Number of worker threads decoding the blocks, default is the hardware concurrency.");
     parser.add_argument("-name").add<std::string>().help("Save file name, location is the same as source, default name is same as source with extension `.png`.");
 
     if(!parser.parse(argc - 1, argv + 1)){
@@ -38,7 +39,8 @@ int main(int argc, char *argv[]){
 
     std::cout << "Start decompressing." << std::endl;
 
-    Image image(compressed_data);
+    size_t threads = parser.used_argument("-threads") ? static_cast<size_t>(parser.get_value<int>("-threads")) : 0;
+    Image image(compressed_data, threads);
 
     image.save(save_path);
 
@@ -0,0 +1,75 @@
+#ifndef ALIGNED_ALLOCATOR__HPP
+#define ALIGNED_ALLOCATOR__HPP
+
+#include <cstddef>
+#include <new>
+#include <limits>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace bfft::matrix{
+
+// Allocates memory aligned to `Alignment` bytes (cache line by default).
+template<typename T, size_t Alignment = 64>
+struct AlignedAllocator{
+    static_assert(Alignment >= alignof(T) && (Alignment & (Alignment - 1)) == 0, "Alignment must be a power of two and at least alignof(T)!");
+
+    using value_type = T;
+
+    template<typename U>
+    struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+    AlignedAllocator() noexcept = default;
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+    T* allocate(size_t n) {
+        if(n > std::numeric_limits<size_t>::max() / sizeof(T)) throw std::bad_array_new_length();
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+    void deallocate(T* p, size_t) noexcept { ::operator delete(p, std::align_val_t(Alignment)); }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept { return true; }
+};
+
+// Cache line aligned allocator, which backs large allocations (at least one huge page) with transparent huge pages where available.
+template<typename T>
+struct HugePageAllocator{
+    static constexpr size_t alignment = 64;
+    static constexpr size_t huge_page_size = 2ul << 20;
+
+    using value_type = T;
+
+    template<typename U>
+    struct rebind { using other = HugePageAllocator<U>; };
+
+    HugePageAllocator() noexcept = default;
+    template<typename U>
+    HugePageAllocator(const HugePageAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        if(n > std::numeric_limits<size_t>::max() / sizeof(T)) throw std::bad_array_new_length();
+        size_t bytes = n * sizeof(T);
+        if(bytes < huge_page_size){
+            return static_cast<T*>(::operator new(bytes, std::align_val_t(alignment)));
+        }
+        void* p = ::operator new(bytes, std::align_val_t(huge_page_size));
+#ifdef __linux__
+        madvise(p, bytes, MADV_HUGEPAGE); // only a hint, failure is not an error
+#endif
+        return static_cast<T*>(p);
+    }
+    void deallocate(T* p, size_t n) noexcept {
+        ::operator delete(p, std::align_val_t(n * sizeof(T) < huge_page_size ? alignment : huge_page_size));
+    }
+
+    template<typename U>
+    bool operator==(const HugePageAllocator<U>&) const noexcept { return true; }
+};
+
+}
+
+#endif //ALIGNED_ALLOCATOR__HPP
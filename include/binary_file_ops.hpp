@@ -2,6 +2,7 @@
 #define BINARY_FILE_OPS__HPP
 
 #include "compression2d.h"
+#include "codebook.h"
 #include "mpl.hpp"
 #include <string>
 #include <fstream>
@@ -41,6 +42,9 @@ void BinaryFileWriter::write<bfft::CompressedData2D::Coefficent>(const bfft::Com
 template<>
 void BinaryFileWriter::write<bfft::CompressedData2D>(const bfft::CompressedData2D& data);
 
+template<>
+void BinaryFileWriter::write<bfft::ParameterSet>(const bfft::ParameterSet& parameters);
+
 template<>
 void BinaryFileWriter::write<CompressedBlock>(const CompressedBlock& data);
 
@@ -86,6 +90,9 @@ void BinaryFileReader::read<bfft::CompressedData2D::Coefficent>(bfft::Compressed
 template<>
 void BinaryFileReader::read<bfft::CompressedData2D>(bfft::CompressedData2D& data);
 
+template<>
+void BinaryFileReader::read<bfft::ParameterSet>(bfft::ParameterSet& parameters);
+
 template<>
 void BinaryFileReader::read<CompressedBlock>(CompressedBlock& data);
 
@@ -0,0 +1,65 @@
+#ifndef CODEBOOK__H
+#define CODEBOOK__H
+
+#include "fft2.hpp"
+#include "split_complex_matrix.hpp"
+#include <array>
+#include <vector>
+#include <filesystem>
+
+namespace bfft{
+
+// Row and column parameters of a block.
+struct ParameterSet{
+    std::vector<std::vector<BlaschkeFunction::value_type>> row_params;
+    std::vector<std::vector<BlaschkeFunction::value_type>> col_params;
+
+    BlaschkeFFT2 make_bfft() const;
+};
+
+// Sum of the squared distances of the values of the block from their mean, unnormalized.
+double block_variance(matrix::SplitComplexView block);
+
+// Gradient energies of lag 1 and 2 along the rows and the columns, relative to the variance of the block.
+using BlockFeatures = std::array<double, 4>;
+BlockFeatures block_features(matrix::SplitComplexView block);
+
+// Parameter sets of optimized blocks, clustered offline, the blocks of an image are encoded with the best of a few
+// entries that had similar features instead of running the optimizer.
+class ParameterCodebook{
+public:
+    static constexpr size_t NO_ENTRY = static_cast<size_t>(-1);
+
+    struct Entry{
+        ParameterSet parameters;
+        BlockFeatures features;
+        // Number of training blocks represented by the entry.
+        double weight = 1;
+    };
+
+    ParameterCodebook() = default;
+    explicit ParameterCodebook(const std::filesystem::path& path) { load(path); }
+
+    // Weighted k-medoids clustering of the samples in parameter space, with at most `size` entries per block size.
+    // An entry is an actual sample, its features are the weighted mean of the features of its cluster.
+    static ParameterCodebook train(const std::vector<Entry>& samples, size_t size, size_t iterations = 20);
+
+    // Indices of the at most `count` entries for `rows` x `cols` blocks with features closest to `features`.
+    std::vector<size_t> candidates(const BlockFeatures& features, size_t rows, size_t cols, size_t count) const;
+    // The candidate with the smallest compression error if it beats zero parameters, otherwise NO_ENTRY.
+    size_t choose(matrix::SplitComplexView block, double ratio, BlaschkeFFT::ResizeType resize_type, size_t count = 4) const;
+
+    const Entry& operator[](size_t i) const { ASSERT(i < m_entries.size(), "Index is out of bounds!"); return m_entries[i]; }
+    const std::vector<Entry>& entries() const { return m_entries; }
+    size_t size() const { return m_entries.size(); }
+
+    void load(const std::filesystem::path& path);
+    void save(const std::filesystem::path& path) const;
+
+private:
+    std::vector<Entry> m_entries;
+};
+
+}
+
+#endif //CODEBOOK__H
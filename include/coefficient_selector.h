@@ -0,0 +1,37 @@
+#ifndef COEFFICIENT_SELECTOR__H
+#define COEFFICIENT_SELECTOR__H
+
+#include <vector>
+#include <span>
+#include <cstddef>
+
+namespace bfft{
+
+// Selects the largest magnitude coefficients in linear time (introselect), reusing its buffers between calls.
+// Order is descending magnitude, equal magnitudes are ordered by descending index, same as a full descending sort by (magnitude, index).
+class CoefficientSelector{
+public:
+    // Resets the selector to `n` coefficients, the returned buffer has to be filled with their magnitudes.
+    std::span<double> reset(size_t n);
+
+    // Moves the indices of the `k` largest coefficients to the front, in unspecified order.
+    void partition(size_t k);
+    // Moves the indices of the `k` largest coefficients to the front in descending order.
+    void select(size_t k);
+
+    // Coefficient indices, the selected ones are in front.
+    std::span<const size_t> indices() const { return m_indices; }
+
+    // Per thread instance, so steady state selections don't allocate.
+    static CoefficientSelector& local();
+
+private:
+    std::vector<double> m_magnitudes;
+    std::vector<size_t> m_indices;
+
+    bool greater(size_t i, size_t j) const { return m_magnitudes[i] != m_magnitudes[j] ? m_magnitudes[i] > m_magnitudes[j] : i > j; }
+};
+
+}
+
+#endif //COEFFICIENT_SELECTOR__H
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <cassert>
+#include <span>
 #include "mpl.hpp"
 #include "fft.hpp"
 #include "fft2.hpp"
@@ -45,6 +46,12 @@ public:
     std::vector<BlaschkeFunction::value_type> this_decompress(const CompressedData1D& data) const;
 
     double compression_error(const std::vector<BlaschkeFunction::value_type>& data) const;
+    // Root of the energy of the dropped coefficients, the error for (near) orthogonal systems without the inverse transform.
+    double truncation_error_estimate(const std::vector<BlaschkeFunction::value_type>& data) const;
+
+    // Same as the ones above with the given transform, these reuse per thread buffers and don't allocate in steady state.
+    static double compression_error(const BlaschkeFFT& bfft, std::span<const BlaschkeFunction::value_type> data, double ratio, BlaschkeFFT::ResizeType resize_type);
+    static double truncation_error_estimate(const BlaschkeFFT& bfft, std::span<const BlaschkeFunction::value_type> data, double ratio, BlaschkeFFT::ResizeType resize_type);
 private:
     BlaschkeFFT m_bfft;
     double m_ratio;
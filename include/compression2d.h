@@ -4,6 +4,7 @@
 #include "matrix.hpp"
 #include "fft.hpp"
 #include "fft2.hpp"
+#include "split_complex_matrix.hpp"
 #include <fstream>
 
 namespace bfft{
@@ -23,6 +24,9 @@ struct CompressedData2D{
     size_t result_rows;
     size_t result_cols;
     bfft::BlaschkeFFT::ResizeType resize_type;
+    // Index of the parameter set of the image channel if the parameters are not stored in the block.
+    static constexpr size_t NO_PARAMETER_SET = static_cast<size_t>(-1);
+    size_t parameter_set = NO_PARAMETER_SET;
 };
 
 class Compressor2D{
@@ -37,16 +41,31 @@ public:
                  BlaschkeFFT::ResizeType resize_type = BlaschkeFFT::ResizeType::RESIZE) 
         : m_bfft(rows, cols), m_ratio(ratio), m_resize_type(resize_type) { ASSERT((0 < ratio && ratio <= 1.0), "Ratio is not between boundaries (0, 1]!"); }
 
-    CompressedData2D compress(const matrix::Matrix<BlaschkeFunction::value_type>& source) const;
+    CompressedData2D compress(matrix::ConstMatrixView<BlaschkeFunction::value_type> source) const;
+    CompressedData2D compress(matrix::SplitComplexView source) const;
     matrix::Matrix<BlaschkeFunction::value_type> decompress(const CompressedData2D& data) const;
     matrix::Matrix<BlaschkeFunction::value_type> this_decompress(const CompressedData2D& data) const;
 
-    double compression_error(const matrix::Matrix<BlaschkeFunction::value_type>& data) const;
+    double compression_error(matrix::ConstMatrixView<BlaschkeFunction::value_type> data) const;
+    double compression_error(matrix::SplitComplexView data) const;
 
     BlaschkeFFT2 get_bfft() const { return m_bfft; }
 
-    static double compression_error(const BlaschkeFFT2& bfft, const matrix::Matrix<BlaschkeFunction::value_type>& data, double ratio, BlaschkeFFT::ResizeType resize_type);
+    static double compression_error(const BlaschkeFFT2& bfft, matrix::ConstMatrixView<BlaschkeFunction::value_type> data, double ratio, BlaschkeFFT::ResizeType resize_type);
+    static double compression_error(const BlaschkeFFT2& bfft, matrix::SplitComplexView data, double ratio, BlaschkeFFT::ResizeType resize_type);
+
+    // Root of the energy of the dropped coefficients, the error for (near) orthogonal systems without the inverse transform.
+    static double truncation_error_estimate(const BlaschkeFFT2& bfft, matrix::ConstMatrixView<BlaschkeFunction::value_type> data, double ratio, BlaschkeFFT::ResizeType resize_type);
+    static double truncation_error_estimate(const BlaschkeFFT2& bfft, matrix::SplitComplexView data, double ratio, BlaschkeFFT::ResizeType resize_type);
+
+    // Same as the ones above, but with an already computed forward transform of `data`, which gets overwritten.
+    static double transformed_compression_error(const BlaschkeFFT2& bfft, matrix::ConstMatrixView<BlaschkeFunction::value_type> data, BlaschkeFFT2::value_type& transformed_data, double ratio, BlaschkeFFT::ResizeType resize_type);
+    static double transformed_compression_error(const BlaschkeFFT2& bfft, matrix::SplitComplexView data, BlaschkeFFT2::value_type& transformed_data, double ratio, BlaschkeFFT::ResizeType resize_type);
+    static double transformed_truncation_error_estimate(const BlaschkeFFT2::value_type& transformed_data, double ratio);
 private:
+    CompressedData2D compress_transformed(const BlaschkeFFT2::value_type& transformed_data, size_t source_rows, size_t source_cols) const;
+
+
     bfft::BlaschkeFFT2 m_bfft;
     double m_ratio;
     BlaschkeFFT::ResizeType m_resize_type;
@@ -9,6 +9,7 @@
 #include <random>
 #include <iterator>
 #include <numbers>
+#include <span>
 
 #include "function_system.h"
 #include "utils.hpp"
@@ -35,6 +36,20 @@ public:
     template<mpl::ContainerType Container>
     std::vector<value_type> ifft(const Container& container, size_t out_n = 0, ResizeType resize_type = ResizeType::RESIZE) const { return ifft(container.begin(), container.end(), out_n, resize_type); }
 
+    // Transforms into `out` of the power of two size of the transform, doesn't allocate once the function system caches are built.
+    template<mpl::InputIteratorType InputIterator>
+    void fft_to(InputIterator first, InputIterator last, std::span<value_type> out, ResizeType resize_type = ResizeType::RESIZE) const;
+    // Inverse transforms the power of two sized `data` in place and resizes it into `out`.
+    void ifft_to(std::span<value_type> data, std::span<value_type> out, ResizeType resize_type = ResizeType::RESIZE) const;
+
+    // Forward transform into `out` and its derivative into `tangent`, with respect to the square of the `lvl` parameter moved along `direction`.
+    template<mpl::InputIteratorType InputIterator>
+    void fft_tangent_to(InputIterator first, InputIterator last, size_t lvl, value_type direction, std::span<value_type> out, std::span<value_type> tangent, ResizeType resize_type = ResizeType::RESIZE) const;
+
+    // Transforms of power of two sized data in place, without resizing.
+    void fft_inplace(std::span<value_type> c) const;
+    void ifft_inplace(std::span<value_type> c) const;
+
     FunctionSystem& function_system() { return m_function_system; }
     const FunctionSystem& function_system() const { return m_function_system; }
 
@@ -43,6 +58,10 @@ public:
     template<mpl::InputIteratorType InputIterator>
     std::vector<value_type> resize_output(InputIterator first, InputIterator last, size_t n, ResizeType resize_type) const;
 
+    template<mpl::InputIteratorType InputIterator>
+    void resize_input_to(InputIterator first, InputIterator last, std::span<value_type> out, ResizeType resize_type) const;
+    void resize_output_to(std::span<const value_type> data, std::span<value_type> out, ResizeType resize_type) const;
+
     template<mpl::InputIteratorType InputIterator>
     std::vector<value_type> resize_vector(InputIterator first, InputIterator last, size_t n) const;
     
@@ -53,19 +72,86 @@ public:
 
 private:
     FunctionSystem m_function_system;
+
+    static void reverse_bit_order(std::span<value_type> c);
 };
 
+inline void BlaschkeFFT::reverse_bit_order(std::span<value_type> c) {
+    size_t n = c.size();
+    for(size_t i = 1, j = 0; i < n; i++){
+        size_t bit = n >> 1;
+        for(; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if(i < j) std::swap(c[i], c[j]);
+    }
+}
+
 template<mpl::InputIteratorType InputIterator>
 std::vector<BlaschkeFFT::value_type> BlaschkeFFT::fft(InputIterator first, InputIterator last, ResizeType resize_type) const {
     int input_size = std::distance(first, last);
     ASSERT((0 < input_size), "Input size must be at least 1!");
 
-    size_t n = 1, n_log = 0;
-    while(n < static_cast<size_t>(input_size)) {
-        n <<= 1;
-        n_log++;
+    std::vector<BlaschkeFFT::value_type> c(ceil_pow2(static_cast<size_t>(input_size)));
+    fft_to(first, last, c, resize_type);
+    return c;
+}
+
+template<mpl::InputIteratorType InputIterator>
+void BlaschkeFFT::fft_to(InputIterator first, InputIterator last, std::span<value_type> out, ResizeType resize_type) const {
+    resize_input_to(first, last, out, resize_type);
+    fft_inplace(out);
+}
+
+template<mpl::InputIteratorType InputIterator>
+void BlaschkeFFT::fft_tangent_to(InputIterator first, InputIterator last, size_t lvl, value_type direction, std::span<value_type> out, std::span<value_type> tangent, ResizeType resize_type) const {
+    size_t n = out.size(), n_log = ceil_log2(n);
+    ASSERT((0 < n && (1ul << n_log) == n && tangent.size() == n), "Sizes must be the same power of two!");
+
+    thread_local std::vector<std::vector<value_type>> base_points;
+    thread_local std::vector<std::vector<value_type>> base_tangents;
+    m_function_system.base_points_tangent(n_log, lvl, direction, base_points, base_tangents);
+
+    resize_input_to(first, last, out, resize_type);
+    if(resize_type == ResizeType::LINEAR_INTERPOLATION){
+        // the samples move along the unit circle with the base points
+        size_t source_size = std::distance(first, last);
+        const std::vector<double>& sample_points = m_function_system.sample_points(n_log, Complex(1));
+        auto base = [&](size_t i) { return InterpolationPoint<double, value_type>{uniform_sample_point<double>(i, source_size), *std::next(first, i)}; };
+        linear_interpolation_slope_to(source_size, base, n, [&](size_t i) { return sample_points[i]; }, tangent.begin());
+        for(size_t i = 0; i < n; i++){
+            tangent[i] *= Complex::conj_mult(base_tangents[n_log][i], base_points[n_log][i]).imag / (std::numbers::pi * 2);
+        }
+    } else {
+        std::fill(tangent.begin(), tangent.end(), value_type(0));
     }
-    std::vector<BlaschkeFFT::value_type> c = resize_input(first, last, n, resize_type);
+
+    for(size_t phase = 0; (1ULL<<phase) < n; phase++){
+        size_t part_width = n / (1ULL<<phase);
+        for(size_t part = 0; part < n / part_width; part++){
+            for(size_t butterfly = 0; butterfly < part_width / 2; butterfly++){
+                size_t i = part_width * part + butterfly;
+                size_t j = i + part_width / 2;
+
+                Complex tmp = out[i];
+                Complex tmp_tangent = tangent[i];
+                out[i] = (tmp + out[j]) * 0.5;
+                tangent[i] = (tmp_tangent + tangent[j]) * 0.5;
+                Complex diff = tmp - out[j];
+                Complex diff_tangent = tmp_tangent - tangent[j];
+                out[j] = Complex::conj_mult(diff, base_points[n_log - phase][butterfly]) * 0.5;
+                tangent[j] = (Complex::conj_mult(diff_tangent, base_points[n_log - phase][butterfly]) + Complex::conj_mult(diff, base_tangents[n_log - phase][butterfly])) * 0.5;
+            }
+        }
+    }
+
+    reverse_bit_order(out);
+    reverse_bit_order(tangent);
+}
+
+inline void BlaschkeFFT::fft_inplace(std::span<value_type> c) const {
+    size_t n = c.size(), n_log = ceil_log2(n);
+    ASSERT((0 < n && (1ul << n_log) == n), "Size must be a power of two!");
+
     const std::vector<std::vector<BlaschkeFFT::value_type>>& base_points = m_function_system.base_points_lvl(n_log, 1);
 
     for(size_t phase = 0; (1ULL<<phase) < n; phase++){
@@ -82,17 +168,7 @@ std::vector<BlaschkeFFT::value_type> BlaschkeFFT::fft(InputIterator first, Input
         }
     }
 
-    std::vector<size_t> reverse_bit_order(n);
-    for(size_t i = 1; i < n; i++){
-        reverse_bit_order[i] = (reverse_bit_order[i / 2] >> 1);
-        if(i&1) reverse_bit_order[i] |= n >> 1;
-    }
-
-    for(size_t i = 0; i < n; i++){
-        if(i < reverse_bit_order[i]) std::swap(c[i], c[reverse_bit_order[i]]);
-    }
-
-    return c;
+    reverse_bit_order(c);
 }
 
 template<mpl::InputIteratorType InputIterator>
@@ -100,28 +176,29 @@ std::vector<BlaschkeFFT::value_type> BlaschkeFFT::ifft(InputIterator first, Inpu
     int input_size = std::distance(first, last);
     ASSERT((0 < input_size), "Input size must be at least 1!");
 
-    size_t n = 1, n_log = 0;
-    while(n < static_cast<size_t>(input_size)) {
-        n <<= 1;
-        n_log++;
-    }
-
+    size_t n = ceil_pow2(static_cast<size_t>(input_size));
     if(out_n == 0) out_n = n;
 
     std::vector<BlaschkeFFT::value_type> c(n);
     std::copy(first, last, c.begin());
 
-    const std::vector<std::vector<BlaschkeFFT::value_type>>& base_points = m_function_system.base_points_lvl(n_log, 1);
+    std::vector<BlaschkeFFT::value_type> result(out_n);
+    ifft_to(c, result, resize_type);
+    return result;
+}
 
-    std::vector<size_t> reverse_bit_order(n);
-    for(size_t i = 1; i < n; i++){
-        reverse_bit_order[i] = (reverse_bit_order[i / 2] >> 1);
-        if(i&1) reverse_bit_order[i] |= n >> 1;
-    }
+inline void BlaschkeFFT::ifft_to(std::span<value_type> data, std::span<value_type> out, ResizeType resize_type) const {
+    ifft_inplace(data);
+    resize_output_to(data, out, resize_type);
+}
 
-    for(size_t i = 0; i < n; i++){
-        if(i < reverse_bit_order[i]) std::swap(c[i], c[reverse_bit_order[i]]);
-    }
+inline void BlaschkeFFT::ifft_inplace(std::span<value_type> c) const {
+    size_t n = c.size(), n_log = ceil_log2(n);
+    ASSERT((0 < n && (1ul << n_log) == n), "Size must be a power of two!");
+
+    const std::vector<std::vector<BlaschkeFFT::value_type>>& base_points = m_function_system.base_points_lvl(n_log, 1);
+
+    reverse_bit_order(c);
 
     for(size_t phase = 1; (1ul<<phase) <= n; phase++){
         size_t part_width = (1ul<<phase);
@@ -137,8 +214,33 @@ std::vector<BlaschkeFFT::value_type> BlaschkeFFT::ifft(InputIterator first, Inpu
             }
         }
     }
+}
 
-    return resize_output(c.begin(), c.end(), out_n, resize_type);
+template<mpl::InputIteratorType InputIterator>
+void BlaschkeFFT::resize_input_to(InputIterator first, InputIterator last, std::span<value_type> out, ResizeType resize_type) const {
+    size_t source_size = std::distance(first, last);
+    if(resize_type == ResizeType::LINEAR_INTERPOLATION){
+        const std::vector<double>& sample_points = m_function_system.sample_points(ceil_log2(out.size()), Complex(1));
+        auto base = [&](size_t i) { return InterpolationPoint<double, value_type>{uniform_sample_point<double>(i, source_size), *std::next(first, i)}; };
+        linear_interpolation_to(source_size, base, out.size(), [&](size_t i) { return sample_points[i]; }, out.begin());
+        return;
+    }
+    size_t count = std::min(source_size, out.size());
+    std::copy(first, std::next(first, count), out.begin());
+    std::fill(out.begin() + count, out.end(), value_type(0));
+}
+
+inline void BlaschkeFFT::resize_output_to(std::span<const value_type> data, std::span<value_type> out, ResizeType resize_type) const {
+    if(resize_type == ResizeType::LINEAR_INTERPOLATION){
+        ASSERT(ceil_pow2(data.size()) == data.size(), "Number of values must be a power of two!");
+        const std::vector<double>& sample_points = m_function_system.sample_points(ceil_log2(data.size()), Complex(1));
+        auto base = [&](size_t i) { return InterpolationPoint<double, value_type>{sample_points[i], data[i]}; };
+        linear_interpolation_to(data.size(), base, out.size(), [&](size_t i) { return uniform_sample_point<double>(i, out.size()); }, out.begin());
+        return;
+    }
+    size_t count = std::min(data.size(), out.size());
+    std::copy(data.begin(), data.begin() + count, out.begin());
+    std::fill(out.begin() + count, out.end(), value_type(0));
 }
 
 template<mpl::InputIteratorType InputIterator>
@@ -3,6 +3,7 @@
 
 #include "fft.hpp"
 #include "matrix.hpp"
+#include "split_complex_matrix.hpp"
 #include "utils.hpp"
 #include "interpolation.hpp"
 
@@ -14,6 +15,7 @@ namespace bfft{
 class BlaschkeFFT2{
 public:
     using value_type = matrix::Matrix<BlaschkeFunction::value_type>;
+    using const_view_type = value_type::const_view_type;
     using ResizeType = BlaschkeFFT::ResizeType;
 
     BlaschkeFFT2(size_t rows, size_t cols, const BlaschkeFFT& default_fft = BlaschkeFFT()) 
@@ -21,8 +23,22 @@ public:
     BlaschkeFFT2(const std::vector<BlaschkeFFT>& fft_rows, const std::vector<BlaschkeFFT>& fft_cols, const BlaschkeFFT& default_fft = BlaschkeFFT()) 
         : m_fft_rows(fft_rows), m_fft_cols(fft_cols), m_default_fft(default_fft) {}
 
-    value_type fft(const value_type& data, ResizeType resize_type = ResizeType::RESIZE) const;
+    value_type fft(const_view_type data, ResizeType resize_type = ResizeType::RESIZE) const;
+    value_type fft(matrix::SplitComplexView data, ResizeType resize_type = ResizeType::RESIZE) const;
     value_type ifft(const value_type& data, size_t out_rows = 0, size_t out_cols = 0, ResizeType resize_type = ResizeType::RESIZE) const;
+    // Workspace versions, the result reuses the storage of `result` and the inverse leaves the output in the top left corner.
+    void fft(const_view_type data, value_type& result, ResizeType resize_type = ResizeType::RESIZE) const;
+    void fft(matrix::SplitComplexView data, value_type& result, ResizeType resize_type = ResizeType::RESIZE) const;
+    void ifft_inplace(value_type& data, size_t out_rows, size_t out_cols, ResizeType resize_type = ResizeType::RESIZE) const;
+
+    // Zero padded working copy of the data, as the forward transform loads it.
+    static value_type load(const_view_type data);
+    static value_type load(matrix::SplitComplexView data);
+    static void load(const_view_type data, value_type& result);
+    static void load(matrix::SplitComplexView data, value_type& result);
+    // The two passes of the forward transform, `in_size` is the unpadded length of the transformed rows/columns.
+    void fft_rows(value_type& mat, size_t in_size, ResizeType resize_type) const;
+    void fft_cols(value_type& mat, size_t in_size, ResizeType resize_type) const;
 
     BlaschkeFFT& get_row_fft(size_t i) { ASSERT(i < m_fft_rows.size(), "Index is out of bounds!"); return m_fft_rows[i]; }
     const BlaschkeFFT& get_row_fft(size_t i) const { return i < m_fft_rows.size() ? m_fft_rows[i] : m_default_fft; }
@@ -37,18 +53,23 @@ public:
     inline size_t cols() const { return m_fft_cols.size(); }
 
 private:
+    // Column passes on at least this many rows run on the transposed matrix.
+    static constexpr size_t TRANSPOSE_THRESHOLD = 64;
+
     std::vector<BlaschkeFFT> m_fft_rows;
     std::vector<BlaschkeFFT> m_fft_cols;
     BlaschkeFFT m_default_fft;
 
     void fft_linear_sub_matrix(const BlaschkeFFT& bfft, value_type::LinearSubMatrixWrapper sub_matrix, size_t in_size, ResizeType resize_type) const;
     void ifft_linear_sub_matrix(const BlaschkeFFT& bfft, value_type::LinearSubMatrixWrapper sub_matrix, size_t in_size, size_t out_size, ResizeType resize_type) const;
-    void fft_rows(value_type& mat, size_t in_size, ResizeType resize_type) const;
     void ifft_rows(value_type& mat, size_t in_size, size_t out_size, ResizeType resize_type) const;
-    void fft_cols(value_type& mat, size_t in_size, ResizeType resize_type) const;
     void ifft_cols(value_type& mat, size_t in_size, size_t out_size, ResizeType resize_type) const;
 };
 
+// Per thread transform of the error computations and the optimizer objectives, reused between their evaluations.
+// A caller passes it on explicitly, nothing that it calls may take it again.
+BlaschkeFFT2::value_type& transform_workspace();
+
 };
 
 #endif //FFT2__HPP
\ No newline at end of file
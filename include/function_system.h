@@ -48,6 +48,10 @@ public:
     const std::vector<BlaschkeFunction::value_type>& base_points(size_t, const BlaschkeFunction::value_type&) const;
     const std::vector<std::vector<BlaschkeFunction::value_type>>& base_points_lvl(size_t, const BlaschkeFunction::value_type&) const;
     const std::vector<double>& sample_points(size_t, const BlaschkeFunction::value_type&) const;
+    // Base points of every level from 1, and their derivatives with respect to the square of the `lvl` parameter moved along `direction`.
+    void base_points_tangent(size_t n, size_t lvl, const BlaschkeFunction::value_type& direction,
+                             std::vector<std::vector<BlaschkeFunction::value_type>>& points,
+                             std::vector<std::vector<BlaschkeFunction::value_type>>& tangents) const;
 
     BlaschkeFunction::value_type eval(size_t n, BlaschkeFunction::value_type x) const;
     BlaschkeFunction::value_type eval_any(size_t n, BlaschkeFunction::value_type x) const;
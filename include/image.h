@@ -9,6 +9,22 @@
 #include "stb_image.h"
 #include "stb_image_write.h"
 #include "optimizer.h"
+#include "codebook.h"
+
+// Colour plane of a channel. The chroma planes may be subsampled, they are upsampled to the size of the luma plane and
+// converted back to RGB by the decoder.
+enum PlaneType {PLAIN, LUMA, CHROMA_BLUE, CHROMA_RED};
+
+// 4:4:4 keeps the chroma planes at full resolution, 4:2:2 halves their width and 4:2:0 both of their sizes.
+enum ChromaSubsampling {CHROMA_444, CHROMA_422, CHROMA_420};
+
+// RGB channels are encoded as YCbCr planes if `ycbcr` is set, the chroma planes keep `chroma_ratio` of their
+// coefficients (0 keeps the ratio of the luma).
+struct ColorSettings{
+    bool ycbcr = false;
+    ChromaSubsampling subsampling = CHROMA_444;
+    double chroma_ratio = 0;
+};
 
 struct CompressedBlock{
     size_t offset_row;
@@ -22,26 +38,39 @@ struct BlockedData{
     std::vector<CompressedBlock> blocks;
     size_t rows;
     size_t cols;
+    PlaneType plane = PLAIN;
+    // Codebook entries used by the blocks, shared instead of stored in every block.
+    std::vector<bfft::ParameterSet> parameter_sets;
 };
 
 class Image{
 public:
-    using Mat = bfft::matrix::Matrix<Complex>;
+    // Channel matrices can be several hundred megapixels, these are backed by huge pages.
+    using Mat = bfft::matrix::Matrix<Complex, bfft::matrix::HugePageAllocator<Complex>>;
     Image(const std::filesystem::path& path, int read_channels = 0);
     Image(const std::vector<Mat>& channels);
-    Image(const std::vector<BlockedData>& channels) : Image(decompress(channels)) {}
+    Image(const std::vector<BlockedData>& channels, size_t threads = 0) : Image(decompress(channels, threads)) {}
     ~Image();
 
     void save(const std::filesystem::path& path);
     std::vector<Mat> convert_to_mat();
+    // Pixel data is real, so the split planes store no imaginary part.
+    std::vector<bfft::matrix::SplitComplexMatrix> convert_to_split_mat();
+    // With a codebook the blocks are encoded with its best matching entries instead of the optimizer.
     std::vector<BlockedData> compress(double ratio, 
                                       bfft::BlaschkeFFT::ResizeType resize_type, 
                                       bfft::OptimizerOpt optimizer_opt, 
                                       size_t block_size = 16, 
-                                      size_t max_iteration = 40, 
-                                      size_t max_shrink = 5);
+                                      const bfft::OptimizerSettings& settings = bfft::OptimizerSettings{40, 5},
+                                      const bfft::ParameterCodebook* codebook = nullptr,
+                                      const ColorSettings& color = ColorSettings());
+    // Parameter sets and features of the blocks of the compressed image, for training a codebook. The shared parameter
+    // sets are the reference parameters with `channel_reuse`, these are sampled once, otherwise they are codebook
+    // entries and skipped.
+    std::vector<bfft::ParameterCodebook::Entry> codebook_samples(const std::vector<BlockedData>& channels, bool channel_reuse = false);
 
-    static std::vector<Mat> decompress(const std::vector<BlockedData>& channels);
+    // The blocks are decoded on `threads` workers, 0 uses every hardware thread.
+    static std::vector<Mat> decompress(const std::vector<BlockedData>& channels, size_t threads = 0);
 private:
     unsigned char* m_image_ptr = nullptr;
     int m_width = 0;
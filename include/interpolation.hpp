@@ -36,6 +36,43 @@ std::vector<U> linear_interpolation_vector(const std::vector<InterpolationPoint<
     return sample_val;
 }
 
+// Same as `linear_interpolation_vector`, the points are given by `base(i)` and `sample_pos(i)` and written to `out`.
+template<typename BaseFun, typename SampleFun, typename OutputIterator>
+void linear_interpolation_to(size_t base_size, BaseFun base, size_t sample_size, SampleFun sample_pos, OutputIterator out) {
+    ASSERT(base_size > 0, "Base points must contain at least 1 point!");
+    size_t j = 0;
+    for(size_t i = 0; i < sample_size; i++, ++out){
+        auto x = sample_pos(i);
+        while(j < base_size && base(j).pos < x){
+            ++j;
+        }
+        size_t idx_prev = (j > 0         ? j - 1 : 0);
+        size_t idx_next = (j < base_size ? j : base_size - 1);
+        *out = linear_interpolation(base(idx_prev), base(idx_next), x);
+    }
+}
+
+// Derivatives of the values of `linear_interpolation_to` with respect to the sample positions.
+template<typename BaseFun, typename SampleFun, typename OutputIterator>
+void linear_interpolation_slope_to(size_t base_size, BaseFun base, size_t sample_size, SampleFun sample_pos, OutputIterator out) {
+    ASSERT(base_size > 0, "Base points must contain at least 1 point!");
+    size_t j = 0;
+    for(size_t i = 0; i < sample_size; i++, ++out){
+        auto x = sample_pos(i);
+        while(j < base_size && base(j).pos < x){
+            ++j;
+        }
+        auto p0 = base(j > 0         ? j - 1 : 0);
+        auto p1 = base(j < base_size ? j : base_size - 1);
+        *out = p0.pos == p1.pos ? decltype(p0.val)(0) : (p1.val - p0.val) / (p1.pos - p0.pos);
+    }
+}
+
+template<typename T>
+inline T uniform_sample_point(size_t i, size_t n){
+    return static_cast<T>(1) / static_cast<T>(n) * static_cast<T>(i);
+}
+
 template<typename T, typename U>
 std::vector<InterpolationPoint<T, U>> create_interpolation_points(const std::vector<T>& pos, const std::vector<U>& val) { 
     ASSERT(pos.size() == val.size(), "Points size and value size must be the same!");
@@ -51,7 +88,7 @@ template<typename T>
 std::vector<T> create_uniform_sample_points(size_t n){
     std::vector<T> result(n);
     for(size_t i = 0; i < n; i++){
-        result[i] = static_cast<T>(1) / static_cast<T>(n) * static_cast<T>(i);
+        result[i] = uniform_sample_point<T>(i, n);
     }
     return result;
 }
@@ -61,10 +98,11 @@ std::vector<InterpolationPoint<T, U>> create_uniform_interpolation_points(const
     return create_interpolation_points(create_uniform_sample_points<double>(v.size()), v);
 }
 
+// Fills `pos` with the sample points, reusing its storage.
 template<typename T>
-std::vector<T> create_sample_points(const FunctionSystem& func_sys, size_t n, Complex val = Complex(1)) {
+void create_sample_points_to(const FunctionSystem& func_sys, size_t n, Complex val, std::vector<T>& pos) {
     const std::vector<BlaschkeFunction::value_type>& base_points = func_sys.base_points(n, val);
-    std::vector<T> pos(base_points.size());
+    pos.resize(base_points.size());
     for(size_t i = 0; i < pos.size(); i++){
         pos[i] = std::acos(std::clamp(base_points[i].real, -1.0, 1.0));
         if(base_points[i].imag < 0.0) pos[i] = std::numbers::pi * 2 - pos[i];
@@ -75,6 +113,12 @@ std::vector<T> create_sample_points(const FunctionSystem& func_sys, size_t n, Co
     size_t idx = std::distance(pos.begin(), std::min_element(pos.begin(), pos.end()));
     for(size_t i = 0; i < idx; i++) pos[i] -= 1.0;
     for(size_t i = 0; i+1 < pos.size(); i++) if(pos[i+1] < pos[i]) pos[i+1] += 1.0;
+}
+
+template<typename T>
+std::vector<T> create_sample_points(const FunctionSystem& func_sys, size_t n, Complex val = Complex(1)) {
+    std::vector<T> pos;
+    create_sample_points_to(func_sys, n, val, pos);
     return pos;
 }
 
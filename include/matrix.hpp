@@ -6,9 +6,13 @@
 #include <cstdio>
 #include <vector>
 #include <compare>
+#include <span>
+#include <type_traits>
 
 #include "utils.hpp"
 #include "mpl.hpp"
+#include "aligned_allocator.hpp"
+#include "transpose.hpp"
 
 namespace bfft::matrix{
     
@@ -18,12 +22,12 @@ struct MatrixConstIterator;
 template<typename T>
 struct MatrixIterator{
     using iterator_category = std::random_access_iterator_tag;
-    using difference_type   = typename std::vector<T>::iterator::difference_type;
+    using difference_type   = std::ptrdiff_t;
     using value_type        = T;
     using pointer           = value_type*;
     using reference         = value_type&;
 
-    MatrixIterator(typename std::vector<T>::iterator iter, difference_type stride) : m_iter(iter), m_stride(stride) {}
+    MatrixIterator(pointer iter, difference_type stride) : m_iter(iter), m_stride(stride) {}
 
     reference operator*() const { return *m_iter; }
     pointer operator->() const { return m_iter; }
@@ -51,19 +55,19 @@ struct MatrixIterator{
     friend struct MatrixConstIterator<T>;
 
 private:
-    typename std::vector<T>::iterator m_iter;
+    pointer m_iter;
     difference_type m_stride;
 };
 
 template<typename T>
 struct MatrixConstIterator{
     using iterator_category = std::random_access_iterator_tag;
-    using difference_type   = typename std::vector<T>::const_iterator::difference_type;
+    using difference_type   = std::ptrdiff_t;
     using value_type        = T;
     using pointer           = const value_type*;
     using reference         = const value_type&;
 
-    MatrixConstIterator(typename std::vector<T>::const_iterator iter, difference_type stride) : m_iter(iter), m_stride(stride) {}
+    MatrixConstIterator(pointer iter, difference_type stride) : m_iter(iter), m_stride(stride) {}
     MatrixConstIterator(MatrixIterator<T> iterator) : m_iter(iterator.m_iter), m_stride(iterator.m_stride) {}
 
     reference operator*() const { return *m_iter; }
@@ -90,14 +94,66 @@ struct MatrixConstIterator{
     friend std::weak_ordering operator<=>(const MatrixConstIterator& a, const MatrixConstIterator& b) { return b.m_iter <=> a.m_iter; }
 
 private:
-    typename std::vector<T>::const_iterator m_iter;
+    pointer m_iter;
     difference_type m_stride;
 };
 
+// Non-owning row-major view into a (sub)matrix: base pointer, extents and row stride.
 template<typename T>
+struct MatrixView{
+public:
+    using element_type = T;
+    using value_type = std::remove_cv_t<T>;
+
+    MatrixView() : m_data(nullptr), m_rows(0), m_cols(0), m_stride(0) {}
+    MatrixView(T* data, size_t rows, size_t cols) : MatrixView(data, rows, cols, cols) {}
+    MatrixView(T* data, size_t rows, size_t cols, size_t stride) : m_data(data), m_rows(rows), m_cols(cols), m_stride(stride) {}
+    template<typename U> requires std::is_convertible_v<U(*)[], T(*)[]>
+    MatrixView(const MatrixView<U>& view) : m_data(view.data()), m_rows(view.rows()), m_cols(view.cols()), m_stride(view.stride()) {}
+
+    inline T* operator[](size_t i) const { return m_data + m_stride * i; }
+    inline std::span<T> get_row(size_t i) const { return std::span<T>(operator[](i), m_cols); }
+
+    inline size_t rows() const { return m_rows; }
+    inline size_t cols() const { return m_cols; }
+    inline size_t stride() const { return m_stride; }
+    inline T* data() const { return m_data; }
+
+    // Clamped to the view boundaries, so blocks on the edges can be smaller than requested.
+    MatrixView subview(size_t offset_row, size_t offset_col, size_t rows, size_t cols) const {
+        ASSERT((offset_row <= m_rows && offset_col <= m_cols), "Offset is out of bounds!");
+        return MatrixView(operator[](offset_row) + offset_col, std::min(rows, m_rows - offset_row), std::min(cols, m_cols - offset_col), m_stride);
+    }
+
+private:
+    T* m_data;
+    size_t m_rows, m_cols;
+    size_t m_stride;
+};
+
+template<typename T>
+using ConstMatrixView = MatrixView<const T>;
+
+template<typename T>
+double mean_squared_error(ConstMatrixView<T> m1, std::type_identity_t<ConstMatrixView<T>> m2){
+    ASSERT((m1.rows() == m2.rows() && m1.cols() == m2.cols()), "The two data size must be equal!");
+    double result = 0;
+    for(size_t i = 0; i < m1.rows(); i++){
+        for(size_t j = 0; j < m1.cols(); j++){
+            result += Complex::abs(m1[i][j] - m2[i][j]);
+        }
+    }
+    return result / (m1.rows() * m1.cols());
+}
+
+template<typename T, typename Allocator = AlignedAllocator<T>>
 struct Matrix{
 public:
     using value_type = T;
+    using allocator_type = Allocator;
+    using storage_type = std::vector<T, Allocator>;
+    using view_type = MatrixView<T>;
+    using const_view_type = ConstMatrixView<T>;
 
     struct ConstLinearSubMatrixWrapper;
 
@@ -105,7 +161,7 @@ public:
         using iterator = MatrixIterator<T>;
         using const_iterator = MatrixConstIterator<T>;
 
-        LinearSubMatrixWrapper(std::vector<T>::iterator begin, std::vector<T>::iterator end, std::vector<T>::iterator::difference_type stride) : m_begin(begin, stride), m_end(end, stride) {}
+        LinearSubMatrixWrapper(T* begin, T* end, iterator::difference_type stride) : m_begin(begin, stride), m_end(end, stride) {}
 
         inline iterator::reference operator[](iterator::difference_type n) { return begin()[n]; }
         inline const_iterator::reference operator[](const_iterator::difference_type n) const { return cbegin()[n]; } 
@@ -126,7 +182,7 @@ public:
     struct ConstLinearSubMatrixWrapper{
         using iterator = MatrixConstIterator<T>;
 
-        ConstLinearSubMatrixWrapper(std::vector<T>::const_iterator begin, std::vector<T>::const_iterator end, std::vector<T>::const_iterator::difference_type stride) : m_begin(begin, stride), m_end(end, stride) {}
+        ConstLinearSubMatrixWrapper(const T* begin, const T* end, iterator::difference_type stride) : m_begin(begin, stride), m_end(end, stride) {}
         ConstLinearSubMatrixWrapper(LinearSubMatrixWrapper wrapper) : m_begin(wrapper.m_begin), m_end(wrapper.m_end) {}
 
         inline iterator::reference operator[](iterator::difference_type n) const { return m_begin[n]; } 
@@ -138,13 +194,18 @@ public:
         iterator m_end;
     };
 
-    Matrix(size_t rows, size_t cols) : m_rows(rows), m_cols(cols), m_data(rows * cols) {}
+    Matrix(size_t rows, size_t cols, size_t pitch = 0) : m_rows(rows), m_cols(cols), m_pitch(pitch == 0 ? cols : pitch), m_data(rows * m_pitch) { ASSERT(m_cols <= m_pitch, "Row pitch must be at least the column count!"); }
     template<mpl::InputIteratorType InputIterator>
-    Matrix(size_t rows, size_t cols, InputIterator first, InputIterator last) : m_rows(rows), m_cols(cols), m_data(rows * cols) { std::copy(first, last, m_data.begin()); }
+    Matrix(size_t rows, size_t cols, InputIterator first, InputIterator last) : m_rows(rows), m_cols(cols), m_pitch(cols), m_data(rows * cols) { std::copy(first, last, m_data.begin()); }
     template<mpl::ContainerType Container>
     Matrix(size_t rows, size_t cols, const Container& container) : Matrix(rows, cols, container.begin(), container.end()) {}
+    explicit Matrix(const_view_type view) : Matrix(view.rows(), view.cols()) { copy_to_pos(this->view(), view, 0, 0); }
+
+    // Resizes to a zero matrix, reusing the storage if it is large enough.
+    void reset(size_t rows, size_t cols, size_t pitch = 0);
 
     void transpose() { m_transpose = !m_transpose; }
+    // Transposes the storage, tiled and in place for square matrices.
     void mem_transpose();
 
     inline LinearSubMatrixWrapper operator[](size_t i) { return get_row(i); }
@@ -164,8 +225,17 @@ public:
     inline size_t rows() const { return m_transpose ? m_cols : m_rows; }
     inline size_t cols() const { return m_transpose ? m_rows : m_cols; }
 
-    inline const std::vector<T>& data() const { return m_data; }
-    inline std::vector<T>& data() { return m_data; }
+    // Row pitch of the storage in elements, rows are padded to it.
+    inline size_t pitch() const { return m_pitch; }
+    static size_t padded_pitch(size_t cols);
+
+    // Underlying storage, contains the row padding if the pitch is larger than the column count.
+    inline const storage_type& data() const { return m_data; }
+    inline storage_type& data() { return m_data; }
+
+    inline view_type view() { ASSERT(!m_transpose, "Only non transposed matrices can be viewed!"); return view_type(m_data.data(), m_rows, m_cols, m_pitch); }
+    inline const_view_type view() const { ASSERT(!m_transpose, "Only non transposed matrices can be viewed!"); return const_view_type(m_data.data(), m_rows, m_cols, m_pitch); }
+    inline operator const_view_type() const { return view(); }
 
     template<mpl::InputIteratorType InputIterator>
     static void copy_to(LinearSubMatrixWrapper _data, InputIterator first, InputIterator last);
@@ -178,36 +248,60 @@ public:
 
     static void copy_to(Matrix& _data, const Matrix& source);
     static void copy_to_pos(Matrix& _data, const Matrix& source, size_t offset_row, size_t offset_col);
+    static void copy_to_pos(view_type _data, const_view_type source, size_t offset_row, size_t offset_col);
     static Matrix submatrix_from_pos(const Matrix& data, size_t offset_row, size_t offset_col, size_t rows, size_t cols);
 private:
     size_t m_rows, m_cols;
-    std::vector<T> m_data;
+    size_t m_pitch;
+    storage_type m_data;
     bool m_transpose = false;
 
-    inline LinearSubMatrixWrapper _row(size_t i) { return LinearSubMatrixWrapper(m_data.begin() + m_cols * i, m_data.begin() + m_cols * (i+1), 1); }
-    inline ConstLinearSubMatrixWrapper _rowc(size_t i) const { return ConstLinearSubMatrixWrapper(m_data.cbegin() + m_cols * i, m_data.cbegin() + m_cols * (i+1), 1); }
-    inline LinearSubMatrixWrapper _col(size_t i) { return LinearSubMatrixWrapper(m_data.begin() + i, m_data.end() + i, m_cols); }
-    inline ConstLinearSubMatrixWrapper _colc(size_t i) const { return ConstLinearSubMatrixWrapper(m_data.cbegin() + i, m_data.cend() + i, m_cols); }
+    inline LinearSubMatrixWrapper _row(size_t i) { return LinearSubMatrixWrapper(m_data.data() + m_pitch * i, m_data.data() + m_pitch * i + m_cols, 1); }
+    inline ConstLinearSubMatrixWrapper _rowc(size_t i) const { return ConstLinearSubMatrixWrapper(m_data.data() + m_pitch * i, m_data.data() + m_pitch * i + m_cols, 1); }
+    inline LinearSubMatrixWrapper _col(size_t i) { return LinearSubMatrixWrapper(m_data.data() + i, m_data.data() + m_pitch * m_rows + i, m_pitch); }
+    inline ConstLinearSubMatrixWrapper _colc(size_t i) const { return ConstLinearSubMatrixWrapper(m_data.data() + i, m_data.data() + m_pitch * m_rows + i, m_pitch); }
 };
 
-template<typename T>
-void Matrix<T>::mem_transpose() {
+template<typename T, typename Allocator>
+size_t Matrix<T, Allocator>::padded_pitch(size_t cols) {
+    static constexpr size_t cache_line = 64;
+    // rows are rounded up to full cache lines
+    size_t bytes = (cols * sizeof(T) + cache_line - 1) / cache_line * cache_line;
+    // strides divisible by 1024 bytes map columns to the same few cache sets, an extra line breaks the aliasing
+    if(bytes % 1024 == 0) bytes += cache_line;
+    return std::max(cols, (bytes + sizeof(T) - 1) / sizeof(T));
+}
+
+template<typename T, typename Allocator>
+void Matrix<T, Allocator>::reset(size_t rows, size_t cols, size_t pitch) {
+    m_rows = rows;
+    m_cols = cols;
+    m_pitch = pitch == 0 ? cols : pitch;
+    m_transpose = false;
+    ASSERT(m_cols <= m_pitch, "Row pitch must be at least the column count!");
+    m_data.assign(rows * m_pitch, T());
+}
+
+template<typename T, typename Allocator>
+void Matrix<T, Allocator>::mem_transpose() {
     if(m_transpose){
         m_transpose = false;
         return;
     }
-    std::vector<T> new_data(m_cols * m_rows);
-    for(size_t i = 0; i < m_rows; i++){
-        for(size_t j = 0; j < m_cols; j++){
-            new_data[m_rows * j + i] = m_data[m_cols * i + j];
-        }
+    if(m_rows == m_cols){
+        transpose_inplace(m_data.data(), m_pitch, m_rows);
+        return;
     }
+    size_t new_pitch = m_pitch == m_cols ? m_rows : padded_pitch(m_rows);
+    storage_type new_data(m_cols * new_pitch);
+    matrix::transpose(m_data.data(), m_pitch, new_data.data(), new_pitch, m_rows, m_cols);
     std::swap(m_data, new_data);
     std::swap(m_rows, m_cols);
+    m_pitch = new_pitch;
 }
 
-template<typename T>
-std::vector<typename Matrix<T>::LinearSubMatrixWrapper> Matrix<T>::get_rows() {
+template<typename T, typename Allocator>
+std::vector<typename Matrix<T, Allocator>::LinearSubMatrixWrapper> Matrix<T, Allocator>::get_rows() {
     std::vector<LinearSubMatrixWrapper> rows_wrapper;
     rows_wrapper.reserve(rows());
     for(size_t i = 0; i < rows(); i++){
@@ -216,8 +310,8 @@ std::vector<typename Matrix<T>::LinearSubMatrixWrapper> Matrix<T>::get_rows() {
     return rows_wrapper;
 }
 
-template<typename T>
-std::vector<typename Matrix<T>::ConstLinearSubMatrixWrapper> Matrix<T>::get_rows() const {
+template<typename T, typename Allocator>
+std::vector<typename Matrix<T, Allocator>::ConstLinearSubMatrixWrapper> Matrix<T, Allocator>::get_rows() const {
     std::vector<ConstLinearSubMatrixWrapper> rows_wrapper;
     rows_wrapper.reserve(rows());
     for(size_t i = 0; i < rows(); i++){
@@ -226,8 +320,8 @@ std::vector<typename Matrix<T>::ConstLinearSubMatrixWrapper> Matrix<T>::get_rows
     return rows_wrapper;
 }
 
-template<typename T>
-std::vector<typename Matrix<T>::LinearSubMatrixWrapper> Matrix<T>::get_cols() {
+template<typename T, typename Allocator>
+std::vector<typename Matrix<T, Allocator>::LinearSubMatrixWrapper> Matrix<T, Allocator>::get_cols() {
     std::vector<LinearSubMatrixWrapper> cols_wrapper;
     cols_wrapper.reserve(cols());
     for(size_t i = 0; i < cols(); i++){
@@ -236,8 +330,8 @@ std::vector<typename Matrix<T>::LinearSubMatrixWrapper> Matrix<T>::get_cols() {
     return cols_wrapper;
 }
 
-template<typename T>
-std::vector<typename Matrix<T>::ConstLinearSubMatrixWrapper> Matrix<T>::get_cols() const {
+template<typename T, typename Allocator>
+std::vector<typename Matrix<T, Allocator>::ConstLinearSubMatrixWrapper> Matrix<T, Allocator>::get_cols() const {
     std::vector<ConstLinearSubMatrixWrapper> cols_wrapper;
     cols_wrapper.reserve(cols());
     for(size_t i = 0; i < cols(); i++){
@@ -246,9 +340,9 @@ std::vector<typename Matrix<T>::ConstLinearSubMatrixWrapper> Matrix<T>::get_cols
     return cols_wrapper;
 }
 
-template<typename T>
+template<typename T, typename Allocator>
 template<mpl::InputIteratorType InputIterator>
-void Matrix<T>::copy_to(LinearSubMatrixWrapper _data, InputIterator first, InputIterator last){
+void Matrix<T, Allocator>::copy_to(LinearSubMatrixWrapper _data, InputIterator first, InputIterator last){
     size_t data_length = std::distance(first, last);
     size_t container_length = std::distance(_data.begin(), _data.end());
     if(data_length <= container_length){
@@ -258,9 +352,9 @@ void Matrix<T>::copy_to(LinearSubMatrixWrapper _data, InputIterator first, Input
     }
 }
 
-template<typename T>
+template<typename T, typename Allocator>
 template<mpl::InputIteratorType InputIterator>
-void Matrix<T>::copy_to_zeros(LinearSubMatrixWrapper _data, InputIterator first, InputIterator last){
+void Matrix<T, Allocator>::copy_to_zeros(LinearSubMatrixWrapper _data, InputIterator first, InputIterator last){
     copy_to(_data, first, last);
     size_t data_length = std::distance(first, last);
     size_t container_length = std::distance(_data.begin(), _data.end());
@@ -269,9 +363,9 @@ void Matrix<T>::copy_to_zeros(LinearSubMatrixWrapper _data, InputIterator first,
     }
 }
 
-template<typename T>
+template<typename T, typename Allocator>
 template<mpl::InputIteratorType InputIterator>
-void Matrix<T>::copy_to_continous(LinearSubMatrixWrapper _data, InputIterator first, InputIterator last){
+void Matrix<T, Allocator>::copy_to_continous(LinearSubMatrixWrapper _data, InputIterator first, InputIterator last){
     copy_to(_data, first, last);
     size_t data_length = std::distance(first, last);
     size_t container_length = std::distance(_data.begin(), _data.end());
@@ -280,9 +374,9 @@ void Matrix<T>::copy_to_continous(LinearSubMatrixWrapper _data, InputIterator fi
     }
 }
 
-template<typename T>
+template<typename T, typename Allocator>
 template<mpl::InputIteratorType InputIterator>
-void Matrix<T>::copy_to_repeat(LinearSubMatrixWrapper _data, InputIterator first, InputIterator last){
+void Matrix<T, Allocator>::copy_to_repeat(LinearSubMatrixWrapper _data, InputIterator first, InputIterator last){
     size_t data_length = std::distance(first, last);
     typename LinearSubMatrixWrapper::iterator it = _data.begin();
     while(it < _data.end()){
@@ -296,16 +390,16 @@ void Matrix<T>::copy_to_repeat(LinearSubMatrixWrapper _data, InputIterator first
     }
 }
 
-template<typename T>
-void Matrix<T>::copy_to(Matrix& _data, const Matrix& source){
+template<typename T, typename Allocator>
+void Matrix<T, Allocator>::copy_to(Matrix& _data, const Matrix& source){
     for(size_t i = 0; i < std::min(_data.rows(), source.rows()); i++){
         auto source_row = source.get_row(i);
         _data.copy_to(_data.get_row(i), source_row.begin(), source_row.end());
     }
 }
 
-template<typename T>
-void Matrix<T>::copy_to_pos(Matrix& _data, const Matrix& source, size_t offset_row, size_t offset_col){
+template<typename T, typename Allocator>
+void Matrix<T, Allocator>::copy_to_pos(Matrix& _data, const Matrix& source, size_t offset_row, size_t offset_col){
     for(size_t i = 0; i < source.rows() && i + offset_row < _data.rows(); i++){
         for(size_t j = 0; j < source.cols() && j + offset_col < _data.cols(); j++){
             _data[offset_row + i][offset_col + j] = source[i][j];
@@ -313,9 +407,18 @@ void Matrix<T>::copy_to_pos(Matrix& _data, const Matrix& source, size_t offset_r
     }
 }
 
+template<typename T, typename Allocator>
+void Matrix<T, Allocator>::copy_to_pos(view_type _data, const_view_type source, size_t offset_row, size_t offset_col){
+    if(offset_row >= _data.rows() || offset_col >= _data.cols()) return;
+    size_t cols = std::min(source.cols(), _data.cols() - offset_col);
+    for(size_t i = 0; i < source.rows() && i + offset_row < _data.rows(); i++){
+        std::copy(source[i], source[i] + cols, _data[offset_row + i] + offset_col);
+    }
+}
 
-template<typename T>
-Matrix<T> Matrix<T>::submatrix_from_pos(const Matrix& data, size_t offset_row, size_t offset_col, size_t rows, size_t cols){
+
+template<typename T, typename Allocator>
+Matrix<T, Allocator> Matrix<T, Allocator>::submatrix_from_pos(const Matrix& data, size_t offset_row, size_t offset_col, size_t rows, size_t cols){
     Matrix result(rows, cols);
      for(size_t i = 0; i < rows && i + offset_row < data.rows(); i++){
         for(size_t j = 0; j < cols && j + offset_col < data.cols(); j++){
@@ -2,6 +2,7 @@
 #define MPL__HPP
 
 #include <type_traits>
+#include <array>
 #include <iterator>
 #include <source_location>
 #include <iostream>
@@ -25,6 +26,12 @@ concept OptimizerFun = requires(Fun fun) {
     {fun(std::valarray<typename Fun::arg_type>(fun.argc()))} -> std::same_as<typename Fun::value_type>;
 };
 
+// Returns its value at `x` and writes the gradient there.
+template<typename Fun, size_t N>
+concept GradientFun = requires(const Fun& fun, const std::array<double, N>& x, std::array<double, N>& gradient) {
+    {fun(x, gradient)} -> std::same_as<double>;
+};
+
 template<typename T>
 concept BooleanTestable = requires(T a) {
     static_cast<bool>(a);
@@ -2,9 +2,15 @@
 #define NELDER_MEAD__HPP
 
 #include <valarray>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <future>
+#include <type_traits>
 #include <cassert>
 #include <cmath>
 #include "mpl.hpp"
+#include "thread_pool.hpp"
 
 template<mpl::OptimizerFun Func>
 class NelderMead{
@@ -31,7 +37,8 @@ public:
 
     static std::vector<args_type> get_starting_points(const args_type& p, typename Func::arg_type shift);
 private:
-    Func m_func;
+    // borrowed, the function has to outlive the optimizer
+    const Func& m_func;
     typename Func::arg_type m_treshold;
     typename Func::arg_type m_alpha; // 0 <
     typename Func::arg_type m_gamma; // 1 < 
@@ -165,4 +172,221 @@ NelderMead<Func>::args_type NelderMead<Func>::find_min(const std::vector<args_ty
     return points[0].args;
 }
 
+// NelderMead with a compile time dimension, the points are stored in place (no heap allocation per step).
+// It performs the same arithmetic as NelderMead, so it visits the same sequence of points.
+template<mpl::OptimizerFun Func, size_t N>
+class FixedNelderMead{
+public:
+    using arg_type = typename Func::arg_type;
+    using args_type = std::array<arg_type, N>;
+
+    struct Point{
+        args_type args;
+        arg_type val;
+        bool operator<(const Point& p) const {
+            if(val != p.val) return val < p.val;
+            for(size_t i = 0; i < N; i++) if(args[i] != p.args[i]) return args[i] < p.args[i];
+            return false;
+        }
+    };
+
+    FixedNelderMead(const Func &func, arg_type treshold = 0.01, arg_type alpha = 1, arg_type gamma = 2, arg_type rho = 0.5, arg_type omega = 0.5) 
+        : m_func(func), m_args(N), m_treshold(treshold), m_alpha(alpha), m_gamma(gamma), m_rho(rho), m_omega(omega) { ASSERT(func.argc() == N, "Argumentum count must be the dimension!"); }
+
+    args_type find_min(const std::array<args_type, N + 1>& starting_points, size_t max_iterations = 50, size_t max_shrink = 3);
+
+    Point create_point(const args_type& args);
+
+    // With more than one thread the reflection, expansion and both contractions of a step (and the shrunk vertices)
+    // are evaluated concurrently on copies of the function. The decision rule, so the visited points, don't change.
+    void set_threads(size_t threads) { m_threads = threads; }
+
+private:
+    struct Worker{
+        Func func;
+        std::valarray<arg_type> args;
+    };
+
+    // borrowed, the function has to outlive the optimizer
+    const Func& m_func;
+    // argument buffer of the function calls
+    std::valarray<arg_type> m_args;
+    size_t m_threads = 1;
+    // copies of the function for the other threads, created by the first concurrent evaluation
+    std::vector<Worker> m_workers;
+    arg_type m_treshold;
+    arg_type m_alpha;
+    arg_type m_gamma;
+    arg_type m_rho;
+    arg_type m_omega;
+
+    bool check_termination(const std::array<Point, N + 1>& points) const;
+    // centroid of every point but the worst
+    args_type get_centroid(const std::array<Point, N + 1>& points) const;
+    // a + (b - a) * t
+    static args_type interpolate(const args_type& a, const args_type& b, arg_type t);
+    // Threads for evaluating `count` points, on a worker of a thread pool only the idle workers help.
+    size_t available_threads(size_t count) const;
+    // Sets the values of the points from their arguments, on at most `threads` threads.
+    void evaluate(Point* points, size_t count, size_t threads);
+    void evaluate(Point* points, size_t count) { evaluate(points, count, available_threads(count)); }
+};
+
+template<mpl::OptimizerFun Func, size_t N>
+typename FixedNelderMead<Func, N>::Point FixedNelderMead<Func, N>::create_point(const args_type& args) {
+    for(size_t i = 0; i < N; i++) m_args[i] = args[i];
+    return Point{args, m_func(m_args)};
+}
+
+template<mpl::OptimizerFun Func, size_t N>
+size_t FixedNelderMead<Func, N>::available_threads(size_t count) const {
+    bfft::ThreadPool* pool = bfft::ThreadPool::current();
+    size_t threads = std::min(m_threads, count);
+    if(pool != nullptr) threads = std::min(threads, pool->idle() + 1);
+    return threads;
+}
+
+template<mpl::OptimizerFun Func, size_t N>
+void FixedNelderMead<Func, N>::evaluate(Point* points, size_t count, size_t threads) {
+    bfft::ThreadPool* pool = bfft::ThreadPool::current();
+    threads = std::min(threads, count);
+    if constexpr (std::is_copy_constructible_v<Func>){
+        if(threads > 1){
+            m_workers.reserve(threads - 1);
+            while(m_workers.size() < threads - 1) m_workers.push_back(Worker{m_func, std::valarray<arg_type>(N)});
+
+            std::vector<std::future<void>> tasks;
+            std::exception_ptr error;
+            try{
+                for(size_t t = 1; t < threads; t++){
+                    auto part = [points, count, threads, t, &worker = m_workers[t - 1]]() {
+                        for(size_t i = t; i < count; i += threads){
+                            for(size_t k = 0; k < N; k++) worker.args[k] = points[i].args[k];
+                            points[i].val = worker.func(worker.args);
+                        }
+                    };
+                    tasks.push_back(pool != nullptr ? pool->submit(part) : std::async(std::launch::async, part));
+                }
+                for(size_t i = 0; i < count; i += threads) points[i] = create_point(points[i].args);
+            } catch(...){
+                error = std::current_exception();
+            }
+            bfft::ThreadPool::wait_all(pool, tasks, error);
+            return;
+        }
+    }
+    for(size_t i = 0; i < count; i++) points[i] = create_point(points[i].args);
+}
+
+template<mpl::OptimizerFun Func, size_t N>
+bool FixedNelderMead<Func, N>::check_termination(const std::array<Point, N + 1>& points) const {
+    if(std::abs(points.back().val - points.front().val) < 1e-4) return true;
+    arg_type max_dist = 0;
+    for(size_t i = 0; i < points.size(); i++){
+        for(size_t j = i + 1; j < points.size(); j++){
+            arg_type sum = 0;
+            for(size_t k = 0; k < N; k++){
+                arg_type d = points[i].args[k] - points[j].args[k];
+                sum += d * d;
+            }
+            max_dist = std::max(max_dist, std::sqrt(sum));
+        }
+    }
+    return max_dist < m_treshold;
+}
+
+template<mpl::OptimizerFun Func, size_t N>
+typename FixedNelderMead<Func, N>::args_type FixedNelderMead<Func, N>::get_centroid(const std::array<Point, N + 1>& points) const {
+    args_type centroid{};
+    for(size_t i = 0; i < N; i++){
+        for(size_t k = 0; k < N; k++) centroid[k] += points[i].args[k];
+    }
+    for(size_t k = 0; k < N; k++) centroid[k] /= static_cast<arg_type>(N);
+    return centroid;
+}
+
+template<mpl::OptimizerFun Func, size_t N>
+typename FixedNelderMead<Func, N>::args_type FixedNelderMead<Func, N>::interpolate(const args_type& a, const args_type& b, arg_type t) {
+    args_type result;
+    for(size_t k = 0; k < N; k++) result[k] = a[k] + (b[k] - a[k]) * t;
+    return result;
+}
+
+template<mpl::OptimizerFun Func, size_t N>
+typename FixedNelderMead<Func, N>::args_type FixedNelderMead<Func, N>::find_min(const std::array<args_type, N + 1>& starting_points, size_t max_iterations, size_t max_shrink) {
+    std::array<Point, N + 1> points;
+    for(size_t i = 0; i < points.size(); i++) points[i].args = starting_points[i];
+    evaluate(points.data(), points.size());
+    std::sort(points.begin(), points.end());
+
+    size_t iterations = 0;
+    size_t shrink_counter = 0;
+    while(iterations < max_iterations && shrink_counter < max_shrink && !check_termination(points)){
+        ++iterations;
+
+        args_type centroid = get_centroid(points);
+
+        // reflection, expansion, outside and inside contraction, evaluated only when needed unless speculative
+        std::array<Point, 4> step;
+        step[0].args = interpolate(centroid, points.back().args, -m_alpha);
+        step[1].args = interpolate(centroid, step[0].args, m_gamma);
+        step[2].args = interpolate(centroid, step[0].args, m_rho);
+        step[3].args = interpolate(centroid, points.back().args, m_rho);
+        // only speculates with spare threads, a busy pool would evaluate every candidate on this thread
+        size_t threads = available_threads(step.size());
+        bool speculative = threads > 1;
+        evaluate(step.data(), speculative ? step.size() : 1, threads);
+
+        // case 1: reflection
+        const Point& reflection = step[0];
+        if(points[0].val <= reflection.val && reflection.val < points[points.size() - 2].val) {
+            points.back() = reflection;
+            std::sort(points.begin(), points.end());
+            shrink_counter = 0;
+            continue;
+        }
+
+        // case 2: expansion
+        if(reflection.val < points[0].val){
+            if(!speculative) evaluate(&step[1], 1, 1);
+            const Point& expansion = step[1];
+            points.back() = expansion.val < reflection.val ? expansion : reflection;
+            std::sort(points.begin(), points.end());
+            shrink_counter = 0;
+            continue;
+        }
+
+        // case 3: contraction
+        if(reflection.val < points.back().val){
+            if(!speculative) evaluate(&step[2], 1, 1);
+            const Point& contraction = step[2];
+            if(contraction.val < reflection.val){
+                points.back() = contraction;
+                std::sort(points.begin(), points.end());
+                shrink_counter = 0;
+                continue;
+            }
+        } else{
+            if(!speculative) evaluate(&step[3], 1, 1);
+            const Point& contraction = step[3];
+            if(contraction.val < points.back().val){
+                points.back() = contraction;
+                std::sort(points.begin(), points.end());
+                shrink_counter = 0;
+                continue;
+            }
+        }
+
+        // case 4: shrink
+        for(size_t i = 1; i < points.size(); i++){
+            for(size_t k = 0; k < N; k++) points[i].args[k] = (points[i].args[k] - points[0].args[k]) * m_omega + points[0].args[k];
+        }
+        evaluate(&points[1], N);
+        std::sort(points.begin(), points.end());
+        shrink_counter++;
+    }
+
+    return points[0].args;
+}
+
 #endif //NELDER_MEAD__HPP
\ No newline at end of file
@@ -6,69 +6,186 @@
 #include "compression.h"
 #include "compression2d.h"
 #include <valarray>
+#include <array>
+#include <memory>
+#include <chrono>
 
 namespace bfft{
 
-enum OptimizerOpt {NO_OPTIMIZE, NELDER_MEAD};
+// QUASI_NEWTON runs a projected quasi-Newton method on the analytic gradient of the truncation error estimate,
+// with respect to the square of the level parameter (the functions depend only on it).
+enum OptimizerOpt {NO_OPTIMIZE, NELDER_MEAD, QUASI_NEWTON};
+
+// EXACT measures the error after the inverse transform, TRANSFORM_PROXY estimates it from the dropped coefficients.
+// With the proxy the optimized parameter of a level is kept only if the exact error does not increase.
+enum ObjectiveType {EXACT, TRANSFORM_PROXY};
+
+// FULL recomputes the whole 2D transform for each evaluation, INCREMENTAL caches the transform without the optimized
+// row (column) and only adds the change caused by it, which is a rank-1 update because the column pass is linear.
+enum EvaluationType {FULL, INCREMENTAL};
+
+// EXHAUSTIVE scans the whole sample grid, HIERARCHICAL scans a coarse polar grid and refines it around its best points.
+enum GridType {EXHAUSTIVE, HIERARCHICAL};
+
+// SEQUENTIAL evaluates the Nelder-Mead step candidates one after another as needed, SPECULATIVE evaluates all of them
+// (and the shrunk vertices) concurrently on the grid threads, trading spare cores for the latency of a block.
+enum StepType {SEQUENTIAL, SPECULATIVE};
+
+// GRID starts every level from the sample grid, NEIGHBOURS encodes the blocks of an image in wavefront order and starts
+// a level from the best of zero and the parameters of the left and top blocks, the grid is scanned only if the best of
+// the neighbours is more than 5% worse than zero. SPECTRUM starts a level along the steepest descent of the truncation
+// error estimate at the zero parameter, derived from the zero parameter transform and its derivative, with the same
+// 5% margin for falling back to the grid.
+enum StartType {GRID, NEIGHBOURS, SPECTRUM};
+
+// PER_LINE optimizes a function system for every row and column of a block, SHARED one for all rows and one for all
+// columns, so a block stores two systems. The shared systems are optimized with Nelder-Mead on the full evaluation.
+enum SharingType {PER_LINE, SHARED};
+
+// SEPARATE optimizes the blocks of every image channel, REUSE optimizes the blocks of the first channel and encodes the
+// co-located blocks of the other channels with their parameters (if these beat zero), REFINE starts a short search of
+// the co-located blocks from them.
+enum ChannelType {SEPARATE, REUSE, REFINE};
+
+struct OptimizerSettings{
+    size_t max_iterations = 50;
+    size_t max_shrink = 5;
+    ObjectiveType objective = ObjectiveType::EXACT;
+    EvaluationType evaluation = EvaluationType::FULL;
+    GridType grid = GridType::EXHAUSTIVE;
+    StepType step = StepType::SEQUENTIAL;
+    // Threads evaluating the sample grid (and the speculative steps) of a level, 0 uses every hardware thread.
+    size_t grid_threads = 0;
+    OptimizerOpt method = OptimizerOpt::NELDER_MEAD;
+    StartType start = StartType::GRID;
+    SharingType sharing = SharingType::PER_LINE;
+    ChannelType channels = ChannelType::SEPARATE;
+    // No level is started after the deadline, the levels optimized until then are kept. The image compressor spends the
+    // time until it on the blocks with the largest error, after encoding every block with zero parameters.
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    // Image blocks that are flat or whose error with zero parameters is below this are not optimized, 0 optimizes every block.
+    double skip_error = 0;
+    // Worker threads of the image compressor, the blocks are encoded on them, 0 uses every hardware thread.
+    size_t threads = 0;
+};
+
+// Already optimized neighbours of a block and its co-located block of the first channel, null if there is none.
+struct WarmStart{
+    const CompressedData2D* left = nullptr;
+    const CompressedData2D* top = nullptr;
+    const CompressedData2D* channel = nullptr;
+};
 
+// Borrowed object, copies own a clone of it, so the copies can be used concurrently.
+template<typename T>
+class CloneOnCopy{
+public:
+    explicit CloneOnCopy(T& object) : m_object(&object) {}
+    CloneOnCopy(const CloneOnCopy& other) : m_owned(std::make_unique<T>(*other.m_object)), m_object(m_owned.get()) {}
+    CloneOnCopy& operator=(const CloneOnCopy&) = delete;
+
+    T& operator*() const { return *m_object; }
+    T* operator->() const { return m_object; }
+
+private:
+    std::unique_ptr<T> m_owned;
+    T* m_object;
+};
+
+// The objectives borrow the data and the transform, the optimized parameter is set in the borrowed transform.
+// Evaluations reuse per thread buffers and don't allocate in steady state.
 class OptimizerFun1D{
 public:
     using arg_type = double;
     using value_type = double;
-    OptimizerFun1D(const std::vector<BlaschkeFFT::value_type> &data, 
-                   const BlaschkeFFT& bfft,
+    OptimizerFun1D(std::span<const BlaschkeFFT::value_type> data, 
+                   BlaschkeFFT& bfft,
                    size_t lvl, 
                    double ratio, 
-                   BlaschkeFFT::ResizeType resize_type)
-        : m_data(data), m_bfft(bfft), m_lvl(lvl), m_ratio(ratio), m_resize_type(resize_type) {}
+                   BlaschkeFFT::ResizeType resize_type,
+                   ObjectiveType objective = ObjectiveType::EXACT)
+        : m_data(data), m_bfft(bfft), m_lvl(lvl), m_ratio(ratio), m_resize_type(resize_type), m_objective(objective) {}
 
     double operator()(const std::valarray<double> &args) const;
+    // Truncation error estimate at the level parameter with square `square`, and its gradient with respect to the real
+    // and imaginary part of the square. The dropped coefficients are the ones dropped at `square`.
+    double truncation_gradient(BlaschkeFunction::value_type square, std::array<double, 2>& gradient) const;
 
     size_t argc() const { return 2; }
 
 private:
-    std::vector<BlaschkeFFT::value_type> m_data;
-    BlaschkeFFT m_bfft;
+    std::span<const BlaschkeFFT::value_type> m_data;
+    CloneOnCopy<BlaschkeFFT> m_bfft;
     size_t m_lvl;
     double m_ratio;
     BlaschkeFFT::ResizeType m_resize_type;
+    ObjectiveType m_objective;
 };
 
+template<typename View = matrix::ConstMatrixView<BlaschkeFFT::value_type>>
 class OptimizerFun2D{
 public:
     using arg_type = double;
     using value_type = double;
-    using Mat = matrix::Matrix<BlaschkeFFT::value_type>;
+    using ConstView = View;
 
-    enum OptType {ROW, COL};
+    // ROWS (COLS) sets the parameter of every row (column), these are always evaluated in full.
+    enum OptType {ROW, COL, ROWS, COLS};
     
-    OptimizerFun2D(const Mat &data, 
-                   const BlaschkeFFT2 &bfft, 
+    OptimizerFun2D(ConstView data, 
+                   BlaschkeFFT2 &bfft, 
                    size_t idx, 
                    size_t lvl, 
                    OptType type, 
                    double ratio, 
-                   BlaschkeFFT::ResizeType resize_type)
-        : m_data(data), m_bfft(bfft), m_idx(idx), m_lvl(lvl), m_type(type), m_ratio(ratio), m_resize_type(resize_type) {}
+                   BlaschkeFFT::ResizeType resize_type,
+                   ObjectiveType objective = ObjectiveType::EXACT,
+                   EvaluationType evaluation = EvaluationType::FULL);
 
     double operator()(const std::valarray<double> &args) const;
+    // Truncation error estimate at the level parameter with square `square`, and its gradient with respect to the real
+    // and imaginary part of the square. The dropped coefficients are the ones dropped at `square`.
+    // Requires the incremental evaluation.
+    double truncation_gradient(BlaschkeFunction::value_type square, std::array<double, 2>& gradient) const;
 
     size_t argc() const { return 2; }
 
 private:
-    Mat m_data;
-    // required for fast optimization
-    mutable BlaschkeFFT2 m_bfft;
+    // Transform state of the starting parameters, shared by the copies of the function.
+    struct IncrementalCache{
+        BlaschkeFFT2::value_type input;
+        BlaschkeFFT2::value_type row_pass;
+        BlaschkeFFT2::value_type transformed;
+        // response[i][j] is the i-th output of column j to a unit impulse in the optimized row (ROW only)
+        BlaschkeFFT2::value_type response;
+    };
+
+    void incremental_transform(BlaschkeFFT2::value_type& transformed) const;
+
+    ConstView m_data;
+    CloneOnCopy<BlaschkeFFT2> m_bfft;
     size_t m_idx;
     size_t m_lvl;
     OptType m_type;
     double m_ratio;
     BlaschkeFFT::ResizeType m_resize_type;
+    ObjectiveType m_objective;
+    std::shared_ptr<const IncrementalCache> m_cache;
+};
+
+// Hits and misses of the per (row/column, level) objective memo of the optimizer since the start of the process.
+struct ObjectiveCacheStats{
+    size_t hits;
+    size_t misses;
 };
 
-BlaschkeFFT optimize_blaschke_fft(const std::vector<BlaschkeFFT::value_type>& data, double ratio, BlaschkeFFT::ResizeType resize_type, size_t max_iterations = 50, size_t max_shrink = 5, size_t sample_radius = 10, size_t sample_angle = 20);
+ObjectiveCacheStats objective_cache_stats();
+
+BlaschkeFFT optimize_blaschke_fft(const std::vector<BlaschkeFFT::value_type>& data, double ratio, BlaschkeFFT::ResizeType resize_type, const OptimizerSettings& settings = OptimizerSettings(), size_t sample_radius = 10, size_t sample_angle = 20);
+
+BlaschkeFFT2 optimize_blaschke_fft(matrix::ConstMatrixView<BlaschkeFFT::value_type> data, double ratio, BlaschkeFFT::ResizeType resize_type, const OptimizerSettings& settings = OptimizerSettings(), const WarmStart& warm_start = WarmStart());
 
-BlaschkeFFT2 optimize_blaschke_fft(const matrix::Matrix<BlaschkeFFT::value_type>& data, double ratio, BlaschkeFFT::ResizeType resize_type, size_t max_iterations = 50, size_t max_shrink = 5);
+BlaschkeFFT2 optimize_blaschke_fft(matrix::SplitComplexView data, double ratio, BlaschkeFFT::ResizeType resize_type, const OptimizerSettings& settings = OptimizerSettings(), const WarmStart& warm_start = WarmStart());
 
 }
 
@@ -0,0 +1,133 @@
+#ifndef QUASI_NEWTON__HPP
+#define QUASI_NEWTON__HPP
+
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include "mpl.hpp"
+
+// Projected BFGS inside the ball of radius `radius` around the origin, with a backtracking (Armijo) line search
+// along the projected path. Each function call returns the value and the gradient.
+template<typename Func, size_t N> requires mpl::GradientFun<Func, N>
+class ProjectedQuasiNewton{
+public:
+    using args_type = std::array<double, N>;
+
+    ProjectedQuasiNewton(const Func& func, double radius, double treshold = 0.001, double initial_step = 0.1)
+        : m_func(func), m_radius(radius), m_treshold(treshold), m_initial_step(initial_step) {}
+
+    args_type find_min(const args_type& start, size_t max_iterations = 50);
+
+    size_t evaluations() const { return m_evaluations; }
+
+private:
+    static constexpr size_t MAX_BACKTRACKS = 10;
+    static constexpr double ARMIJO = 1e-4;
+
+    // borrowed, the function has to outlive the optimizer
+    const Func& m_func;
+    double m_radius;
+    double m_treshold;
+    double m_initial_step; // length of the first step, before any curvature is known
+    size_t m_evaluations = 0;
+
+    args_type project(const args_type& x) const;
+
+    static double dot(const args_type& x, const args_type& y);
+};
+
+template<typename Func, size_t N> requires mpl::GradientFun<Func, N>
+double ProjectedQuasiNewton<Func, N>::dot(const args_type& x, const args_type& y) {
+    double result = 0;
+    for(size_t i = 0; i < N; i++) result += x[i] * y[i];
+    return result;
+}
+
+template<typename Func, size_t N> requires mpl::GradientFun<Func, N>
+typename ProjectedQuasiNewton<Func, N>::args_type ProjectedQuasiNewton<Func, N>::project(const args_type& x) const {
+    double length = std::sqrt(dot(x, x));
+    if(length <= m_radius) return x;
+    args_type result;
+    for(size_t i = 0; i < N; i++) result[i] = x[i] * (m_radius / length);
+    return result;
+}
+
+template<typename Func, size_t N> requires mpl::GradientFun<Func, N>
+typename ProjectedQuasiNewton<Func, N>::args_type ProjectedQuasiNewton<Func, N>::find_min(const args_type& start, size_t max_iterations) {
+    // inverse Hessian estimate
+    std::array<args_type, N> h{};
+    for(size_t i = 0; i < N; i++) h[i][i] = 1;
+
+    args_type x = project(start);
+    args_type gradient;
+    double value = m_func(x, gradient);
+    m_evaluations++;
+
+    for(size_t iteration = 0; iteration < max_iterations; iteration++){
+        args_type direction{};
+        for(size_t i = 0; i < N; i++){
+            for(size_t j = 0; j < N; j++) direction[i] -= h[i][j] * gradient[j];
+        }
+        if(dot(direction, gradient) >= 0){
+            // not a descent direction, restart from the gradient
+            for(size_t i = 0; i < N; i++){
+                h[i].fill(0);
+                h[i][i] = 1;
+                direction[i] = -gradient[i];
+            }
+        }
+        double length = std::sqrt(dot(direction, direction));
+        if(length == 0) break;
+
+        double step = iteration == 0 ? std::min(1.0, m_initial_step / length) : 1.0;
+        bool accepted = false;
+        args_type next;
+        args_type next_gradient;
+        double next_value = value;
+        for(size_t backtrack = 0; backtrack < MAX_BACKTRACKS; backtrack++, step /= 2){
+            for(size_t i = 0; i < N; i++) next[i] = x[i] + direction[i] * step;
+            next = project(next);
+            args_type shift;
+            for(size_t i = 0; i < N; i++) shift[i] = next[i] - x[i];
+            next_value = m_func(next, next_gradient);
+            m_evaluations++;
+            if(next_value <= value + ARMIJO * dot(gradient, shift)){
+                accepted = true;
+                break;
+            }
+        }
+        if(!accepted) break;
+
+        args_type s, y;
+        for(size_t i = 0; i < N; i++){
+            s[i] = next[i] - x[i];
+            y[i] = next_gradient[i] - gradient[i];
+        }
+        bool converged = std::sqrt(dot(s, s)) < m_treshold || std::abs(value - next_value) < 1e-4;
+        x = next;
+        value = next_value;
+        gradient = next_gradient;
+        if(converged) break;
+
+        // BFGS update of the inverse Hessian, skipped without positive curvature
+        double sy = dot(s, y);
+        if(sy <= 1e-12) continue;
+        if(iteration == 0){
+            double scale = sy / dot(y, y);
+            for(size_t i = 0; i < N; i++) h[i][i] = scale;
+        }
+        args_type hy{};
+        for(size_t i = 0; i < N; i++){
+            for(size_t j = 0; j < N; j++) hy[i] += h[i][j] * y[j];
+        }
+        double yhy = dot(y, hy);
+        for(size_t i = 0; i < N; i++){
+            for(size_t j = 0; j < N; j++){
+                h[i][j] += (sy + yhy) * s[i] * s[j] / (sy * sy) - (hy[i] * s[j] + s[i] * hy[j]) / sy;
+            }
+        }
+    }
+    return x;
+}
+
+#endif //QUASI_NEWTON__HPP
@@ -0,0 +1,118 @@
+#ifndef SPLIT_COMPLEX_MATRIX__HPP
+#define SPLIT_COMPLEX_MATRIX__HPP
+
+#include "matrix.hpp"
+#include "complex.h"
+#include "aligned_allocator.hpp"
+
+namespace bfft::matrix{
+
+// Non-owning view into separate real and imaginary planes, an empty imaginary plane means it is all zero.
+struct SplitComplexView{
+    using value_type = Complex;
+
+    ConstMatrixView<double> real;
+    ConstMatrixView<double> imag;
+
+    inline size_t rows() const { return real.rows(); }
+    inline size_t cols() const { return real.cols(); }
+    inline bool has_imag() const { return imag.data() != nullptr; }
+
+    inline Complex get(size_t i, size_t j) const { return has_imag() ? Complex(real[i][j], imag[i][j]) : Complex(real[i][j]); }
+
+    SplitComplexView subview(size_t offset_row, size_t offset_col, size_t rows, size_t cols) const {
+        return SplitComplexView{real.subview(offset_row, offset_col, rows, cols),
+                                has_imag() ? imag.subview(offset_row, offset_col, rows, cols) : ConstMatrixView<double>()};
+    }
+};
+
+// Complex matrix stored as separate real and imaginary planes (SoA).
+// The imaginary plane is only allocated when a non-zero imaginary value is stored.
+class SplitComplexMatrix{
+public:
+    using value_type = Complex;
+    using plane_type = Matrix<double, HugePageAllocator<double>>;
+
+    SplitComplexMatrix(size_t rows, size_t cols, size_t pitch = 0) : m_real(rows, cols, pitch), m_imag(0, 0) {}
+    explicit SplitComplexMatrix(ConstMatrixView<Complex> source);
+
+    inline size_t rows() const { return m_real.rows(); }
+    inline size_t cols() const { return m_real.cols(); }
+    inline bool has_imag() const { return m_has_imag; }
+
+    inline plane_type::view_type real() { return m_real.view(); }
+    inline plane_type::const_view_type real() const { return m_real.view(); }
+    // Mutable access materializes the imaginary plane.
+    inline plane_type::view_type imag() { materialize_imag(); return m_imag.view(); }
+    inline plane_type::const_view_type imag() const { return m_has_imag ? m_imag.view() : plane_type::const_view_type(); }
+
+    inline Complex get(size_t i, size_t j) const { return view().get(i, j); }
+    inline void set(size_t i, size_t j, const Complex& z);
+
+    inline SplitComplexView view() const { return SplitComplexView{real(), imag()}; }
+    inline operator SplitComplexView() const { return view(); }
+
+    void materialize_imag();
+
+    Matrix<Complex> to_matrix() const;
+    static SplitComplexMatrix submatrix_from_pos(SplitComplexView data, size_t offset_row, size_t offset_col, size_t rows, size_t cols);
+
+private:
+    plane_type m_real;
+    plane_type m_imag;
+    bool m_has_imag = false;
+};
+
+inline SplitComplexMatrix::SplitComplexMatrix(ConstMatrixView<Complex> source) : SplitComplexMatrix(source.rows(), source.cols(), plane_type::padded_pitch(source.cols())) {
+    for(size_t i = 0; i < rows(); i++){
+        for(size_t j = 0; j < cols(); j++){
+            set(i, j, source[i][j]);
+        }
+    }
+}
+
+inline void SplitComplexMatrix::set(size_t i, size_t j, const Complex& z) {
+    m_real.view()[i][j] = z.real;
+    if(m_has_imag || z.imag != 0.0) imag()[i][j] = z.imag;
+}
+
+inline void SplitComplexMatrix::materialize_imag() {
+    if(m_has_imag) return;
+    m_imag = plane_type(m_real.rows(), m_real.cols(), m_real.pitch());
+    m_has_imag = true;
+}
+
+inline Matrix<Complex> SplitComplexMatrix::to_matrix() const {
+    Matrix<Complex> result(rows(), cols());
+    SplitComplexView source = view();
+    for(size_t i = 0; i < rows(); i++){
+        for(size_t j = 0; j < cols(); j++){
+            result[i][j] = source.get(i, j);
+        }
+    }
+    return result;
+}
+
+inline SplitComplexMatrix SplitComplexMatrix::submatrix_from_pos(SplitComplexView data, size_t offset_row, size_t offset_col, size_t rows, size_t cols) {
+    SplitComplexMatrix result(rows, cols);
+    plane_type::copy_to_pos(result.real(), data.real.subview(offset_row, offset_col, rows, cols), 0, 0);
+    if(data.has_imag()){
+        plane_type::copy_to_pos(result.imag(), data.imag.subview(offset_row, offset_col, rows, cols), 0, 0);
+    }
+    return result;
+}
+
+inline double mean_squared_error(SplitComplexView m1, ConstMatrixView<Complex> m2){
+    ASSERT((m1.rows() == m2.rows() && m1.cols() == m2.cols()), "The two data size must be equal!");
+    double result = 0;
+    for(size_t i = 0; i < m1.rows(); i++){
+        for(size_t j = 0; j < m1.cols(); j++){
+            result += Complex::abs(m1.get(i, j) - m2[i][j]);
+        }
+    }
+    return result / (m1.rows() * m1.cols());
+}
+
+}
+
+#endif //SPLIT_COMPLEX_MATRIX__HPP
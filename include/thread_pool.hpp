@@ -0,0 +1,205 @@
+#ifndef THREAD_POOL__HPP
+#define THREAD_POOL__HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace bfft{
+
+// Work-stealing pool of a fixed number of worker threads. Tasks submitted from outside of the pool go to a bounded
+// shared queue in submission order, submitting blocks while it is full. Tasks submitted by a worker go to its own
+// queue, the worker takes them newest first and the other workers steal them oldest first. An exception of a task is
+// rethrown by its future.
+class ThreadPool{
+public:
+    // 0 threads uses every hardware thread, 0 capacity queues a few tasks per thread.
+    explicit ThreadPool(size_t threads = 0, size_t capacity = 0);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    // Finishes the queued tasks before joining the workers.
+    ~ThreadPool();
+
+    template<typename Fun>
+    std::future<std::invoke_result_t<Fun>> submit(Fun fun);
+    // Result of a task, a worker runs the queued tasks of the workers while it waits and counts as idle while it
+    // has nothing to run.
+    template<typename T>
+    T get(std::future<T>& future);
+
+    // Waits for every future, on the pool if it is not null, then rethrows `error` (an exception of the calling thread)
+    // or else the first exception of the tasks. No task outlives the data it references.
+    static void wait_all(ThreadPool* pool, std::vector<std::future<void>>& futures, std::exception_ptr error = nullptr);
+
+    inline size_t size() const { return m_threads.size(); }
+    // Workers without a task or waiting for one with nothing to steal, a hint for splitting a task.
+    inline size_t idle() const { return m_idle.load(std::memory_order_relaxed); }
+    // Pool of the calling worker thread, null outside of the pools.
+    static ThreadPool* current() { return t_pool; }
+
+private:
+    static constexpr size_t TASKS_PER_THREAD = 4;
+    // Sleep of a waiting worker between two attempts to steal.
+    static constexpr std::chrono::microseconds WAIT_SLICE{200};
+
+    struct WorkerQueue{
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+    };
+
+    std::vector<std::thread> m_threads;
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+    std::deque<std::function<void()>> m_shared;
+    size_t m_capacity;
+    // tasks in any of the queues
+    size_t m_pending = 0;
+    std::atomic<size_t> m_idle = 0;
+    bool m_stop = false;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_not_full;
+
+    inline static thread_local ThreadPool* t_pool = nullptr;
+    inline static thread_local size_t t_index = 0;
+
+    void work(size_t index);
+    // Runs a task of the own queue, else of the shared queue if `shared` is set, else one stolen from another worker.
+    // The tasks of the shared queue come first, so the parts of a task are only stolen once the queue is empty.
+    bool run_one(size_t index, bool shared);
+    bool pop_task(size_t index, bool shared, std::function<void()>& task);
+};
+
+inline ThreadPool::ThreadPool(size_t threads, size_t capacity) {
+    if(threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    m_capacity = capacity == 0 ? TASKS_PER_THREAD * threads : capacity;
+    for(size_t t = 0; t < threads; t++) m_queues.push_back(std::make_unique<WorkerQueue>());
+    m_threads.reserve(threads);
+    for(size_t t = 0; t < threads; t++) m_threads.emplace_back(&ThreadPool::work, this, t);
+}
+
+inline ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for(auto& thread : m_threads) thread.join();
+}
+
+template<typename Fun>
+std::future<std::invoke_result_t<Fun>> ThreadPool::submit(Fun fun) {
+    // std::function needs a copyable target, the task is shared
+    auto task = std::make_shared<std::packaged_task<std::invoke_result_t<Fun>()>>(std::move(fun));
+    auto result = task->get_future();
+    if(t_pool == this){
+        // counted first, so a thief never takes it before it is counted
+        {
+            std::lock_guard lock(m_mutex);
+            m_pending++;
+        }
+        std::lock_guard lock(m_queues[t_index]->mutex);
+        m_queues[t_index]->tasks.emplace_back([task]() { (*task)(); });
+    } else{
+        std::unique_lock lock(m_mutex);
+        m_not_full.wait(lock, [this]() { return m_shared.size() < m_capacity; });
+        m_shared.emplace_back([task]() { (*task)(); });
+        m_pending++;
+    }
+    m_wake.notify_one();
+    return result;
+}
+
+template<typename T>
+T ThreadPool::get(std::future<T>& future) {
+    if(t_pool == this){
+        // only the worker queues, so a waiting task doesn't start an unrelated one from the shared queue
+        while(future.wait_for(std::chrono::seconds(0)) != std::future_status::ready){
+            if(run_one(t_index, false)) continue;
+            // nothing to steal, the worker sleeps on the future as an idle one and looks for new parts periodically
+            m_idle++;
+            future.wait_for(WAIT_SLICE);
+            m_idle--;
+        }
+    }
+    return future.get();
+}
+
+inline void ThreadPool::wait_all(ThreadPool* pool, std::vector<std::future<void>>& futures, std::exception_ptr error) {
+    for(auto& future : futures){
+        try{
+            if(pool != nullptr) pool->get(future);
+            else future.get();
+        } catch(...){
+            if(!error) error = std::current_exception();
+        }
+    }
+    if(error) std::rethrow_exception(error);
+}
+
+inline bool ThreadPool::pop_task(size_t index, bool shared, std::function<void()>& task) {
+    {
+        std::lock_guard lock(m_queues[index]->mutex);
+        if(!m_queues[index]->tasks.empty()){
+            task = std::move(m_queues[index]->tasks.back());
+            m_queues[index]->tasks.pop_back();
+            return true;
+        }
+    }
+    if(shared){
+        std::unique_lock lock(m_mutex);
+        if(!m_shared.empty()){
+            task = std::move(m_shared.front());
+            m_shared.pop_front();
+            lock.unlock();
+            m_not_full.notify_one();
+            return true;
+        }
+    }
+    for(size_t k = 1; k < m_queues.size(); k++){
+        WorkerQueue& victim = *m_queues[(index + k) % m_queues.size()];
+        std::lock_guard lock(victim.mutex);
+        if(!victim.tasks.empty()){
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool ThreadPool::run_one(size_t index, bool shared) {
+    std::function<void()> task;
+    if(!pop_task(index, shared, task)) return false;
+    {
+        std::lock_guard lock(m_mutex);
+        m_pending--;
+    }
+    task();
+    return true;
+}
+
+inline void ThreadPool::work(size_t index) {
+    t_pool = this;
+    t_index = index;
+    while(true){
+        if(run_one(index, true)) continue;
+        std::unique_lock lock(m_mutex);
+        m_idle++;
+        m_wake.wait(lock, [this]() { return m_stop || m_pending > 0; });
+        m_idle--;
+        if(m_stop && m_pending == 0) return;
+    }
+}
+
+}
+
+#endif //THREAD_POOL__HPP
@@ -0,0 +1,107 @@
+#ifndef TRANSPOSE__HPP
+#define TRANSPOSE__HPP
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <utility>
+
+namespace bfft::matrix{
+
+namespace transpose_detail{
+
+// Tiles of both the source and destination fit into L1 together.
+inline constexpr size_t TILE = 32;
+inline constexpr size_t MICRO = 4;
+// Smaller matrices are transposed on the calling thread.
+inline constexpr size_t PARALLEL_BYTES = 4ul << 20;
+
+template<typename Fun>
+void parallel_for(size_t count, size_t bytes, Fun fun) {
+    size_t threads = bytes < PARALLEL_BYTES ? 1 : std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+    if(threads <= 1){
+        for(size_t i = 0; i < count; i++) fun(i);
+        return;
+    }
+    // interleaved, so the uneven rows of the in-place triangle are balanced
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+    for(size_t t = 0; t < threads; t++){
+        workers.emplace_back([=]() { for(size_t i = t; i < count; i += threads) fun(i); });
+    }
+    for(auto& worker : workers) worker.join();
+}
+
+template<typename T>
+inline void transpose_micro(const T* src, size_t src_pitch, T* dst, size_t dst_pitch) {
+    for(size_t i = 0; i < MICRO; i++){
+        for(size_t j = 0; j < MICRO; j++){
+            dst[j * dst_pitch + i] = src[i * src_pitch + j];
+        }
+    }
+}
+
+template<typename T>
+void transpose_tile(const T* src, size_t src_pitch, T* dst, size_t dst_pitch, size_t rows, size_t cols) {
+    size_t i = 0;
+    for(; i + MICRO <= rows; i += MICRO){
+        size_t j = 0;
+        for(; j + MICRO <= cols; j += MICRO){
+            transpose_micro(src + i * src_pitch + j, src_pitch, dst + j * dst_pitch + i, dst_pitch);
+        }
+        for(; j < cols; j++){
+            for(size_t k = i; k < i + MICRO; k++) dst[j * dst_pitch + k] = src[k * src_pitch + j];
+        }
+    }
+    for(; i < rows; i++){
+        for(size_t j = 0; j < cols; j++) dst[j * dst_pitch + i] = src[i * src_pitch + j];
+    }
+}
+
+template<typename T>
+void swap_tiles(T* data, size_t pitch, size_t row, size_t col, size_t rows, size_t cols) {
+    for(size_t i = row; i < row + rows; i++){
+        for(size_t j = col; j < col + cols; j++){
+            std::swap(data[i * pitch + j], data[j * pitch + i]);
+        }
+    }
+}
+
+}
+
+// Cache blocked out-of-place transpose of a `rows` x `cols` matrix, `dst` gets `cols` rows.
+template<typename T>
+void transpose(const T* src, size_t src_pitch, T* dst, size_t dst_pitch, size_t rows, size_t cols) {
+    using namespace transpose_detail;
+    size_t tile_rows = (rows + TILE - 1) / TILE;
+    parallel_for(tile_rows, rows * cols * sizeof(T), [=](size_t tile) {
+        size_t i = tile * TILE;
+        for(size_t j = 0; j < cols; j += TILE){
+            transpose_tile(src + i * src_pitch + j, src_pitch, dst + j * dst_pitch + i, dst_pitch, std::min(TILE, rows - i), std::min(TILE, cols - j));
+        }
+    });
+}
+
+// Cache blocked in-place transpose of an `n` x `n` matrix.
+template<typename T>
+void transpose_inplace(T* data, size_t pitch, size_t n) {
+    using namespace transpose_detail;
+    size_t tiles = (n + TILE - 1) / TILE;
+    parallel_for(tiles, n * n * sizeof(T), [=](size_t tile) {
+        size_t i = tile * TILE;
+        size_t rows = std::min(TILE, n - i);
+        // diagonal tile, only the upper triangle is swapped
+        for(size_t k = 0; k < rows; k++){
+            for(size_t l = k + 1; l < rows; l++){
+                std::swap(data[(i + k) * pitch + i + l], data[(i + l) * pitch + i + k]);
+            }
+        }
+        for(size_t j = i + TILE; j < n; j += TILE){
+            swap_tiles(data, pitch, i, j, rows, std::min(TILE, n - j));
+        }
+    });
+}
+
+}
+
+#endif //TRANSPOSE__HPP
@@ -25,6 +25,13 @@ void BinaryFileWriter::write<bfft::CompressedData2D>(const bfft::CompressedData2
     write(data.result_rows);
     write(data.result_cols);
     write(data.resize_type);
+    write(data.parameter_set);
+}
+
+template<>
+void BinaryFileWriter::write<bfft::ParameterSet>(const bfft::ParameterSet& parameters){
+    write(parameters.row_params);
+    write(parameters.col_params);
 }
 
 template<>
@@ -41,6 +48,8 @@ void BinaryFileWriter::write<BlockedData>(const BlockedData& data){
     write(data.blocks);
     write(data.rows);
     write(data.cols);
+    write(data.parameter_sets);
+    write(data.plane);
 }
 
 template<>
@@ -75,6 +84,13 @@ void BinaryFileReader::read<bfft::CompressedData2D>(bfft::CompressedData2D& data
     read(data.result_rows);
     read(data.result_cols);
     read(data.resize_type);
+    read(data.parameter_set);
+}
+
+template<>
+void BinaryFileReader::read<bfft::ParameterSet>(bfft::ParameterSet& parameters){
+    read(parameters.row_params);
+    read(parameters.col_params);
 }
 
 template<>
@@ -91,6 +107,8 @@ void BinaryFileReader::read<BlockedData>(BlockedData& data){
     read(data.blocks);
     read(data.rows);
     read(data.cols);
+    read(data.parameter_sets);
+    read(data.plane);
 }
 
 template<>
@@ -0,0 +1,222 @@
+#include "../include/codebook.h"
+#include "../include/compression2d.h"
+#include "../include/binary_file_ops.hpp"
+#include <map>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+
+using namespace bfft;
+
+namespace {
+
+// Medoids are searched among at most this many members of a cluster.
+constexpr size_t MEDOID_CANDIDATES = 256;
+
+// Missing parameters of a line are zero, same as the default of the function system.
+double line_distance(const std::vector<BlaschkeFunction::value_type>& a, const std::vector<BlaschkeFunction::value_type>& b) {
+    double result = 0;
+    for(size_t i = 0; i < std::max(a.size(), b.size()); i++){
+        BlaschkeFunction::value_type x = i < a.size() ? a[i] : BlaschkeFunction::value_type(0);
+        BlaschkeFunction::value_type y = i < b.size() ? b[i] : BlaschkeFunction::value_type(0);
+        result += Complex::norm(x - y);
+    }
+    return result;
+}
+
+double parameter_distance(const ParameterSet& a, const ParameterSet& b) {
+    double result = 0;
+    for(size_t i = 0; i < a.row_params.size(); i++) result += line_distance(a.row_params[i], b.row_params[i]);
+    for(size_t i = 0; i < a.col_params.size(); i++) result += line_distance(a.col_params[i], b.col_params[i]);
+    return result;
+}
+
+double feature_distance(const BlockFeatures& a, const BlockFeatures& b) {
+    double result = 0;
+    for(size_t i = 0; i < a.size(); i++) result += (a[i] - b[i]) * (a[i] - b[i]);
+    return result;
+}
+
+// Clusters the `members` of the samples (all of the same block size) into at most `size` entries.
+std::vector<ParameterCodebook::Entry> cluster(const std::vector<ParameterCodebook::Entry>& samples, const std::vector<size_t>& members, size_t size, size_t iterations) {
+    auto distance = [&](size_t i, size_t j) { return parameter_distance(samples[members[i]].parameters, samples[members[j]].parameters); };
+    size_t n = members.size();
+
+    // farthest point initialization from the heaviest sample, so training is deterministic
+    std::vector<size_t> medoids{0};
+    for(size_t i = 1; i < n; i++){
+        if(samples[members[i]].weight > samples[members[medoids[0]]].weight) medoids[0] = i;
+    }
+    std::vector<double> nearest(n, std::numeric_limits<double>::infinity());
+    while(medoids.size() < size){
+        size_t farthest = 0;
+        double farthest_score = 0;
+        for(size_t i = 0; i < n; i++){
+            nearest[i] = std::min(nearest[i], distance(i, medoids.back()));
+            double score = samples[members[i]].weight * nearest[i];
+            if(score > farthest_score){
+                farthest = i;
+                farthest_score = score;
+            }
+        }
+        // the rest of the samples are duplicates of the medoids
+        if(farthest_score == 0) break;
+        medoids.push_back(farthest);
+    }
+
+    std::vector<std::vector<size_t>> clusters(medoids.size());
+    for(size_t iteration = 0; iteration <= iterations; iteration++){
+        for(auto& cluster : clusters) cluster.clear();
+        for(size_t i = 0; i < n; i++){
+            size_t best = 0;
+            double best_distance = std::numeric_limits<double>::infinity();
+            for(size_t k = 0; k < medoids.size(); k++){
+                double d = distance(i, medoids[k]);
+                if(d < best_distance){
+                    best = k;
+                    best_distance = d;
+                }
+            }
+            clusters[best].push_back(i);
+        }
+        if(iteration == iterations) break;
+
+        bool changed = false;
+        for(size_t k = 0; k < medoids.size(); k++){
+            const auto& cluster = clusters[k];
+            size_t stride = (cluster.size() + MEDOID_CANDIDATES - 1) / MEDOID_CANDIDATES;
+            size_t best = medoids[k];
+            double best_cost = std::numeric_limits<double>::infinity();
+            for(size_t c = 0; c < cluster.size(); c += stride){
+                double cost = 0;
+                for(size_t i : cluster) cost += samples[members[i]].weight * distance(cluster[c], i);
+                if(cost < best_cost){
+                    best = cluster[c];
+                    best_cost = cost;
+                }
+            }
+            changed |= best != medoids[k];
+            medoids[k] = best;
+        }
+        if(!changed) break;
+    }
+
+    std::vector<ParameterCodebook::Entry> result;
+    for(size_t k = 0; k < medoids.size(); k++){
+        if(clusters[k].empty()) continue;
+        ParameterCodebook::Entry entry{samples[members[medoids[k]]].parameters, BlockFeatures{}, 0};
+        for(size_t i : clusters[k]){
+            const auto& sample = samples[members[i]];
+            entry.weight += sample.weight;
+            for(size_t f = 0; f < entry.features.size(); f++) entry.features[f] += sample.weight * sample.features[f];
+        }
+        for(double& feature : entry.features) feature /= entry.weight;
+        result.push_back(std::move(entry));
+    }
+    return result;
+}
+
+}
+
+BlaschkeFFT2 ParameterSet::make_bfft() const {
+    std::vector<BlaschkeFFT> fft_rows(row_params.size());
+    std::vector<BlaschkeFFT> fft_cols(col_params.size());
+    for(size_t i = 0; i < row_params.size(); i++) fft_rows[i] = BlaschkeFFT(FunctionSystem(row_params[i]));
+    for(size_t i = 0; i < col_params.size(); i++) fft_cols[i] = BlaschkeFFT(FunctionSystem(col_params[i]));
+    return BlaschkeFFT2(fft_rows, fft_cols);
+}
+
+double bfft::block_variance(matrix::SplitComplexView block) {
+    Complex mean(0);
+    for(size_t i = 0; i < block.rows(); i++){
+        for(size_t j = 0; j < block.cols(); j++) mean += block.get(i, j);
+    }
+    mean = mean / static_cast<double>(block.rows() * block.cols());
+    double variance = 0;
+    for(size_t i = 0; i < block.rows(); i++){
+        for(size_t j = 0; j < block.cols(); j++) variance += Complex::norm(block.get(i, j) - mean);
+    }
+    return variance;
+}
+
+BlockFeatures bfft::block_features(matrix::SplitComplexView block) {
+    double variance = block_variance(block);
+    BlockFeatures features{};
+    if(variance == 0) return features;
+
+    for(size_t lag = 1; lag <= 2; lag++){
+        double row_energy = 0;
+        double col_energy = 0;
+        for(size_t i = 0; i < block.rows(); i++){
+            for(size_t j = 0; j + lag < block.cols(); j++) row_energy += Complex::norm(block.get(i, j + lag) - block.get(i, j));
+        }
+        for(size_t i = 0; i + lag < block.rows(); i++){
+            for(size_t j = 0; j < block.cols(); j++) col_energy += Complex::norm(block.get(i + lag, j) - block.get(i, j));
+        }
+        features[2 * (lag - 1)] = block.cols() > lag ? row_energy / (variance * (block.cols() - lag) / block.cols()) : 0;
+        features[2 * (lag - 1) + 1] = block.rows() > lag ? col_energy / (variance * (block.rows() - lag) / block.rows()) : 0;
+    }
+    return features;
+}
+
+ParameterCodebook ParameterCodebook::train(const std::vector<Entry>& samples, size_t size, size_t iterations) {
+    ASSERT(size > 0, "Codebook size must be positive!");
+    // the parameter sets of different block sizes are not comparable
+    std::map<std::pair<size_t, size_t>, std::vector<size_t>> groups;
+    for(size_t i = 0; i < samples.size(); i++){
+        groups[{samples[i].parameters.row_params.size(), samples[i].parameters.col_params.size()}].push_back(i);
+    }
+    ParameterCodebook result;
+    for(const auto& [block_size, members] : groups){
+        for(auto& entry : cluster(samples, members, size, iterations)) result.m_entries.push_back(std::move(entry));
+    }
+    return result;
+}
+
+std::vector<size_t> ParameterCodebook::candidates(const BlockFeatures& features, size_t rows, size_t cols, size_t count) const {
+    std::vector<size_t> result;
+    for(size_t i = 0; i < m_entries.size(); i++){
+        if(m_entries[i].parameters.row_params.size() == rows && m_entries[i].parameters.col_params.size() == cols) result.push_back(i);
+    }
+    count = std::min(count, result.size());
+    std::partial_sort(result.begin(), result.begin() + count, result.end(), [&](size_t a, size_t b) {
+        return feature_distance(m_entries[a].features, features) < feature_distance(m_entries[b].features, features);
+    });
+    result.resize(count);
+    return result;
+}
+
+size_t ParameterCodebook::choose(matrix::SplitComplexView block, double ratio, BlaschkeFFT::ResizeType resize_type, size_t count) const {
+    size_t best = NO_ENTRY;
+    double best_error = Compressor2D::compression_error(BlaschkeFFT2(block.rows(), block.cols()), block, ratio, resize_type);
+    for(size_t i : candidates(block_features(block), block.rows(), block.cols(), count)){
+        double error = Compressor2D::compression_error(m_entries[i].parameters.make_bfft(), block, ratio, resize_type);
+        if(error < best_error){
+            best = i;
+            best_error = error;
+        }
+    }
+    return best;
+}
+
+void ParameterCodebook::load(const std::filesystem::path& path) {
+    BinaryFileReader freader(path);
+    size_t size;
+    freader.read(size);
+    m_entries.resize(size);
+    for(Entry& entry : m_entries){
+        freader.read(entry.parameters);
+        freader.read(entry.features);
+        freader.read(entry.weight);
+    }
+}
+
+void ParameterCodebook::save(const std::filesystem::path& path) const {
+    BinaryFileWriter fwriter(path);
+    fwriter.write(m_entries.size());
+    for(const Entry& entry : m_entries){
+        fwriter.write(entry.parameters);
+        fwriter.write(entry.features);
+        fwriter.write(entry.weight);
+    }
+}
@@ -0,0 +1,29 @@
+#include "../include/coefficient_selector.h"
+#include "../include/mpl.hpp"
+#include <algorithm>
+#include <numeric>
+
+using namespace bfft;
+
+std::span<double> CoefficientSelector::reset(size_t n) {
+    m_magnitudes.resize(n);
+    m_indices.resize(n);
+    std::iota(m_indices.begin(), m_indices.end(), static_cast<size_t>(0));
+    return m_magnitudes;
+}
+
+void CoefficientSelector::partition(size_t k) {
+    ASSERT(k <= m_indices.size(), "Cannot select more coefficients than available!");
+    if(k == 0 || k == m_indices.size()) return;
+    std::nth_element(m_indices.begin(), m_indices.begin() + (k - 1), m_indices.end(), [this](size_t i, size_t j) { return greater(i, j); });
+}
+
+void CoefficientSelector::select(size_t k) {
+    partition(k);
+    std::sort(m_indices.begin(), m_indices.begin() + k, [this](size_t i, size_t j) { return greater(i, j); });
+}
+
+CoefficientSelector& CoefficientSelector::local() {
+    thread_local CoefficientSelector selector;
+    return selector;
+}
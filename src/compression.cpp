@@ -1,20 +1,42 @@
 #include "../include/compression.h"
+#include "../include/coefficient_selector.h"
 
 using namespace bfft;
 
+namespace {
+
+CoefficientSelector& load_magnitudes(std::span<const BlaschkeFunction::value_type> transformed_data) {
+    CoefficientSelector& selector = CoefficientSelector::local();
+    std::span<double> magnitudes = selector.reset(transformed_data.size());
+    for(size_t i = 0; i < transformed_data.size(); i++) {
+        magnitudes[i] = Complex::abs(transformed_data[i]);
+    }
+    return selector;
+}
+
+// Per thread buffers of the error computations.
+std::span<BlaschkeFunction::value_type> workspace(size_t slot, size_t n) {
+    thread_local std::vector<BlaschkeFunction::value_type> buffers[2];
+    if(buffers[slot].size() < n) buffers[slot].resize(n);
+    return std::span<BlaschkeFunction::value_type>(buffers[slot].data(), n);
+}
+
+size_t split_size(size_t size, double ratio) {
+    return std::min(static_cast<size_t>(static_cast<double>(size) * ratio), size);
+}
+
+}
+
 CompressedData1D Compressor1D::compress(const std::vector<BlaschkeFunction::value_type> &source) const {
     auto transformed_data = m_bfft.fft(source, m_resize_type);
-    std::vector<CompressedData1D::Coefficent> coefs(transformed_data.size());
-    for(size_t i = 0; i < transformed_data.size(); i++) {
-        coefs[i] = CompressedData1D::Coefficent{i, transformed_data[i]};
+    size_t split = split_size(transformed_data.size(), m_ratio);
+    CoefficientSelector& selector = load_magnitudes(transformed_data);
+    selector.select(split);
+    std::vector<CompressedData1D::Coefficent> coefs(split);
+    for(size_t i = 0; i < split; i++) {
+        size_t id = selector.indices()[i];
+        coefs[i] = CompressedData1D::Coefficent{id, transformed_data[id]};
     }
-    std::sort(coefs.rbegin(), coefs.rend(), [](const CompressedData1D::Coefficent &coef1, const CompressedData1D::Coefficent &coef2) {
-        double value_abs1 = Complex::abs(coef1.value);
-        double value_abs2 = Complex::abs(coef2.value);
-        return value_abs1 != value_abs2 ? value_abs1 < value_abs2 : coef1.id < coef2.id;
-    });
-    size_t split = std::min(static_cast<size_t>(static_cast<double>(transformed_data.size()) * m_ratio), coefs.size());
-    coefs.resize(split);
     return CompressedData1D{coefs, m_bfft.function_system().get_function_params(), transformed_data.size(), source.size(), m_resize_type};
 }
 
@@ -47,4 +69,31 @@ double Compressor1D::compression_error(const std::vector<BlaschkeFunction::value
     auto compression_result = compress(data);
     auto decompression_result = this_decompress(compression_result);
     return mean_squared_error(data, decompression_result);
-}
\ No newline at end of file
+}
+
+double Compressor1D::truncation_error_estimate(const std::vector<BlaschkeFunction::value_type>& data) const {
+    return truncation_error_estimate(m_bfft, data, m_ratio, m_resize_type);
+}
+
+double Compressor1D::compression_error(const BlaschkeFFT& bfft, std::span<const BlaschkeFunction::value_type> data, double ratio, BlaschkeFFT::ResizeType resize_type) {
+    auto transformed_data = workspace(0, ceil_pow2(data.size()));
+    bfft.fft_to(data.begin(), data.end(), transformed_data, resize_type);
+    size_t split = split_size(transformed_data.size(), ratio);
+    CoefficientSelector& selector = load_magnitudes(transformed_data);
+    selector.partition(split);
+    for(size_t id : selector.indices().subspan(split)) transformed_data[id] = BlaschkeFunction::value_type(0);
+    auto result = workspace(1, data.size());
+    bfft.ifft_to(transformed_data, result, resize_type);
+    return mean_squared_error(data.begin(), data.end(), result.begin(), result.end());
+}
+
+double Compressor1D::truncation_error_estimate(const BlaschkeFFT& bfft, std::span<const BlaschkeFunction::value_type> data, double ratio, BlaschkeFFT::ResizeType resize_type) {
+    auto transformed_data = workspace(0, ceil_pow2(data.size()));
+    bfft.fft_to(data.begin(), data.end(), transformed_data, resize_type);
+    size_t split = split_size(transformed_data.size(), ratio);
+    CoefficientSelector& selector = load_magnitudes(transformed_data);
+    selector.partition(split);
+    double energy = 0;
+    for(size_t id : selector.indices().subspan(split)) energy += Complex::norm(transformed_data[id]);
+    return std::sqrt(energy);
+}
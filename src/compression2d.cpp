@@ -1,7 +1,57 @@
 #include "../include/compression2d.h"
+#include "../include/coefficient_selector.h"
 
 using namespace bfft;
 
+namespace {
+
+// Loads the magnitudes of the transformed data in row-major order, so index order matches (id_x, id_y) order.
+CoefficientSelector& load_magnitudes(const BlaschkeFFT2::value_type& transformed_data) {
+    CoefficientSelector& selector = CoefficientSelector::local();
+    std::span<double> magnitudes = selector.reset(transformed_data.rows() * transformed_data.cols());
+    for(size_t i = 0; i < transformed_data.rows(); i++){
+        auto row = transformed_data.get_row(i);
+        for(size_t j = 0; j < transformed_data.cols(); j++){
+            magnitudes[i * transformed_data.cols() + j] = Complex::abs(row[j]);
+        }
+    }
+    return selector;
+}
+
+// Error of the transform truncated to the `ratio` largest coefficients, without building the compressed data.
+// The transformed data is overwritten by the inverse transform.
+template<typename View>
+double truncated_compression_error(const BlaschkeFFT2& bfft, View data, BlaschkeFFT2::value_type& transformed_data, double ratio, BlaschkeFFT::ResizeType resize_type) {
+    size_t cols = transformed_data.cols();
+    size_t count = transformed_data.rows() * cols;
+    size_t split = std::min(static_cast<size_t>(count * ratio), count);
+    CoefficientSelector& selector = load_magnitudes(transformed_data);
+    selector.partition(split);
+    for(size_t idx : selector.indices().subspan(split)) transformed_data[idx / cols][idx % cols] = BlaschkeFunction::value_type(0);
+    bfft.ifft_inplace(transformed_data, data.rows(), data.cols(), resize_type);
+    return matrix::mean_squared_error(data, transformed_data.view().subview(0, 0, data.rows(), data.cols()));
+}
+
+template<typename View>
+double truncated_compression_error(const BlaschkeFFT2& bfft, View data, double ratio, BlaschkeFFT::ResizeType resize_type) {
+    BlaschkeFFT2::value_type& transformed_data = transform_workspace();
+    bfft.fft(data, transformed_data, resize_type);
+    return truncated_compression_error(bfft, data, transformed_data, ratio, resize_type);
+}
+
+double truncated_energy(const BlaschkeFFT2::value_type& transformed_data, double ratio) {
+    size_t cols = transformed_data.cols();
+    size_t count = transformed_data.rows() * cols;
+    size_t split = std::min(static_cast<size_t>(count * ratio), count);
+    CoefficientSelector& selector = load_magnitudes(transformed_data);
+    selector.partition(split);
+    double energy = 0;
+    for(size_t idx : selector.indices().subspan(split)) energy += Complex::norm(transformed_data[idx / cols][idx % cols]);
+    return std::sqrt(energy);
+}
+
+}
+
 bool CompressedData2D::Coefficent::operator<(const Coefficent& coef) const {
     double abs1 = Complex::abs(value);
     double abs2 = Complex::abs(coef.value);
@@ -21,17 +71,25 @@ Compressor2D::Compressor2D(const std::vector<std::vector<BlaschkeFunction::value
     m_bfft.set_fft_cols(fft_cols);
 }
 
-CompressedData2D Compressor2D::compress(const matrix::Matrix<BlaschkeFunction::value_type>& source) const {
-    auto transformed_data = m_bfft.fft(source, m_resize_type);
-    std::vector<CompressedData2D::Coefficent> coefs(transformed_data.rows() * transformed_data.cols());
-    for(size_t i = 0; i < transformed_data.rows(); i++){
-        for(size_t j = 0; j < transformed_data.cols(); j++){
-            coefs[i * transformed_data.cols() + j] = {i, j, transformed_data[i][j]};
-        }
+CompressedData2D Compressor2D::compress(matrix::ConstMatrixView<BlaschkeFunction::value_type> source) const {
+    return compress_transformed(m_bfft.fft(source, m_resize_type), source.rows(), source.cols());
+}
+
+CompressedData2D Compressor2D::compress(matrix::SplitComplexView source) const {
+    return compress_transformed(m_bfft.fft(source, m_resize_type), source.rows(), source.cols());
+}
+
+CompressedData2D Compressor2D::compress_transformed(const BlaschkeFFT2::value_type& transformed_data, size_t source_rows, size_t source_cols) const {
+    size_t cols = transformed_data.cols();
+    size_t count = transformed_data.rows() * cols;
+    size_t split = std::min(static_cast<size_t>(count * m_ratio), count);
+    CoefficientSelector& selector = load_magnitudes(transformed_data);
+    selector.select(split);
+    std::vector<CompressedData2D::Coefficent> coefs(split);
+    for(size_t i = 0; i < split; i++){
+        size_t idx = selector.indices()[i];
+        coefs[i] = {idx / cols, idx % cols, transformed_data[idx / cols][idx % cols]};
     }
-    std::sort(coefs.rbegin(), coefs.rend());
-    size_t split = std::min(static_cast<size_t>(coefs.size() * m_ratio), coefs.size());
-    coefs.resize(split);
     std::vector<std::vector<BlaschkeFunction::value_type>> row_params(m_bfft.rows());
     std::vector<std::vector<BlaschkeFunction::value_type>> col_params(m_bfft.cols());
     for(size_t i = 0; i < m_bfft.rows(); i++){
@@ -40,7 +98,7 @@ CompressedData2D Compressor2D::compress(const matrix::Matrix<BlaschkeFunction::v
     for(size_t i = 0; i < m_bfft.cols(); i++){
         col_params[i] = m_bfft.get_col_fft(i).function_system().get_function_params();
     }
-    return CompressedData2D{coefs, row_params, col_params, transformed_data.rows(), transformed_data.cols(), source.rows(), source.cols(), m_resize_type};  
+    return CompressedData2D{coefs, row_params, col_params, transformed_data.rows(), transformed_data.cols(), source_rows, source_cols, m_resize_type};  
 }
 
 matrix::Matrix<BlaschkeFunction::value_type> Compressor2D::decompress(const CompressedData2D& data) const {
@@ -48,10 +106,11 @@ matrix::Matrix<BlaschkeFunction::value_type> Compressor2D::decompress(const Comp
     for(auto [id_x, id_y, value] : data.data){
         transformed_data[id_x][id_y] = value;
     }
-    std::vector<BlaschkeFFT> row_ffts(data.row_params.size());
-    std::vector<BlaschkeFFT> col_ffts(data.col_params.size());
-    for(size_t i = 0; i < data.row_params.size(); i++) row_ffts[i] = BlaschkeFFT(data.row_params[i]);
-    for(size_t i = 0; i < data.col_params.size(); i++) col_ffts[i] = BlaschkeFFT(data.col_params[i]);
+    // a single row (column) system is shared by every row (column)
+    std::vector<BlaschkeFFT> row_ffts(data.row_params.size() == 1 ? data.result_rows : data.row_params.size());
+    std::vector<BlaschkeFFT> col_ffts(data.col_params.size() == 1 ? data.result_cols : data.col_params.size());
+    for(size_t i = 0; i < row_ffts.size(); i++) row_ffts[i] = BlaschkeFFT(data.row_params[data.row_params.size() == 1 ? 0 : i]);
+    for(size_t i = 0; i < col_ffts.size(); i++) col_ffts[i] = BlaschkeFFT(data.col_params[data.col_params.size() == 1 ? 0 : i]);
     BlaschkeFFT2 bfft(row_ffts, col_ffts);
     auto result = bfft.ifft(transformed_data, data.result_rows, data.result_cols, data.resize_type);
     return result;
@@ -66,23 +125,46 @@ matrix::Matrix<BlaschkeFunction::value_type> Compressor2D::this_decompress(const
     return result;
 }
 
-double Compressor2D::compression_error(const matrix::Matrix<BlaschkeFunction::value_type>& data) const {
+double Compressor2D::compression_error(matrix::ConstMatrixView<BlaschkeFunction::value_type> data) const {
     auto compressed_data = compress(data);
     auto result = this_decompress(compressed_data);
-    return mean_squared_error(data.data(), result.data());
+    return matrix::mean_squared_error(data, result);
 }
 
- double Compressor2D::compression_error(const BlaschkeFFT2& bfft, const matrix::Matrix<BlaschkeFunction::value_type>& data, double ratio, BlaschkeFFT::ResizeType resize_type) {
-    auto transformed_data = bfft.fft(data, resize_type);
-    std::vector<CompressedData2D::Coefficent> coefs(transformed_data.rows() * transformed_data.cols());
-    for(size_t i = 0; i < transformed_data.rows(); i++){
-        for(size_t j = 0; j < transformed_data.cols(); j++){
-            coefs[i * transformed_data.cols() + j] = {i, j, transformed_data[i][j]};
-        }
-    }
-    std::sort(coefs.rbegin(), coefs.rend());
-    size_t split = std::min(static_cast<size_t>(coefs.size() * ratio), coefs.size());
-    for(size_t i = std::max(split, static_cast<size_t>(0)); i < coefs.size(); i++) transformed_data[coefs[i].id_x][coefs[i].id_y] = BlaschkeFunction::value_type(0);
-    auto result = bfft.ifft(transformed_data, data.rows(), data.cols(), resize_type);
-    return mean_squared_error(data.data(), result.data());
- }
\ No newline at end of file
+double Compressor2D::compression_error(matrix::SplitComplexView data) const {
+    auto compressed_data = compress(data);
+    auto result = this_decompress(compressed_data);
+    return matrix::mean_squared_error(data, result);
+}
+
+double Compressor2D::compression_error(const BlaschkeFFT2& bfft, matrix::ConstMatrixView<BlaschkeFunction::value_type> data, double ratio, BlaschkeFFT::ResizeType resize_type) {
+    return truncated_compression_error(bfft, data, ratio, resize_type);
+}
+
+double Compressor2D::compression_error(const BlaschkeFFT2& bfft, matrix::SplitComplexView data, double ratio, BlaschkeFFT::ResizeType resize_type) {
+    return truncated_compression_error(bfft, data, ratio, resize_type);
+}
+
+double Compressor2D::truncation_error_estimate(const BlaschkeFFT2& bfft, matrix::ConstMatrixView<BlaschkeFunction::value_type> data, double ratio, BlaschkeFFT::ResizeType resize_type) {
+    BlaschkeFFT2::value_type& transformed_data = transform_workspace();
+    bfft.fft(data, transformed_data, resize_type);
+    return truncated_energy(transformed_data, ratio);
+}
+
+double Compressor2D::truncation_error_estimate(const BlaschkeFFT2& bfft, matrix::SplitComplexView data, double ratio, BlaschkeFFT::ResizeType resize_type) {
+    BlaschkeFFT2::value_type& transformed_data = transform_workspace();
+    bfft.fft(data, transformed_data, resize_type);
+    return truncated_energy(transformed_data, ratio);
+}
+
+double Compressor2D::transformed_compression_error(const BlaschkeFFT2& bfft, matrix::ConstMatrixView<BlaschkeFunction::value_type> data, BlaschkeFFT2::value_type& transformed_data, double ratio, BlaschkeFFT::ResizeType resize_type) {
+    return truncated_compression_error(bfft, data, transformed_data, ratio, resize_type);
+}
+
+double Compressor2D::transformed_compression_error(const BlaschkeFFT2& bfft, matrix::SplitComplexView data, BlaschkeFFT2::value_type& transformed_data, double ratio, BlaschkeFFT::ResizeType resize_type) {
+    return truncated_compression_error(bfft, data, transformed_data, ratio, resize_type);
+}
+
+double Compressor2D::transformed_truncation_error_estimate(const BlaschkeFFT2::value_type& transformed_data, double ratio) {
+    return truncated_energy(transformed_data, ratio);
+}
\ No newline at end of file
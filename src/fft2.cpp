@@ -2,6 +2,17 @@
 
 using namespace bfft;
 
+namespace {
+
+// Per thread buffers of the row and column transforms, so the passes don't allocate in steady state.
+std::span<BlaschkeFFT::value_type> line_buffer(size_t slot, size_t n) {
+    thread_local std::vector<BlaschkeFFT::value_type> buffers[2];
+    if(buffers[slot].size() < n) buffers[slot].resize(n);
+    return std::span<BlaschkeFFT::value_type>(buffers[slot].data(), n);
+}
+
+}
+
 void BlaschkeFFT2::set_fft_rows(const std::vector<BlaschkeFFT>& ffts) {
     m_fft_rows = ffts;
 }
@@ -10,16 +21,57 @@ void BlaschkeFFT2::set_fft_cols(const std::vector<BlaschkeFFT>& ffts) {
     m_fft_cols = ffts;
 }
 
-BlaschkeFFT2::value_type BlaschkeFFT2::fft(const value_type& mat, ResizeType resize_type) const {
-    size_t rows = ceil_pow2(mat.rows());
+void BlaschkeFFT2::load(const_view_type mat, value_type& result) {
     size_t cols = ceil_pow2(mat.cols());
+    result.reset(ceil_pow2(mat.rows()), cols, value_type::padded_pitch(cols));
+    value_type::copy_to_pos(result.view(), mat, 0, 0);
+}
 
-    value_type result(rows, cols);
-    value_type::copy_to(result, mat);
+void BlaschkeFFT2::load(matrix::SplitComplexView mat, value_type& result) {
+    size_t cols = ceil_pow2(mat.cols());
+    result.reset(ceil_pow2(mat.rows()), cols, value_type::padded_pitch(cols));
+    for(size_t i = 0; i < mat.rows(); i++){
+        auto row = result.get_row(i);
+        for(size_t j = 0; j < mat.cols(); j++){
+            row[j] = mat.get(i, j);
+        }
+    }
+}
+
+BlaschkeFFT2::value_type BlaschkeFFT2::load(const_view_type mat) {
+    value_type result(0, 0);
+    load(mat, result);
+    return result;
+}
+
+BlaschkeFFT2::value_type BlaschkeFFT2::load(matrix::SplitComplexView mat) {
+    value_type result(0, 0);
+    load(mat, result);
+    return result;
+}
+
+BlaschkeFFT2::value_type BlaschkeFFT2::fft(const_view_type mat, ResizeType resize_type) const {
+    value_type result(0, 0);
+    fft(mat, result, resize_type);
+    return result;
+}
+
+BlaschkeFFT2::value_type BlaschkeFFT2::fft(matrix::SplitComplexView mat, ResizeType resize_type) const {
+    value_type result(0, 0);
+    fft(mat, result, resize_type);
+    return result;
+}
 
+void BlaschkeFFT2::fft(const_view_type mat, value_type& result, ResizeType resize_type) const {
+    load(mat, result);
+    fft_rows(result, mat.cols(), resize_type);
+    fft_cols(result, mat.rows(), resize_type);
+}
+
+void BlaschkeFFT2::fft(matrix::SplitComplexView mat, value_type& result, ResizeType resize_type) const {
+    load(mat, result);
     fft_rows(result, mat.cols(), resize_type);
     fft_cols(result, mat.rows(), resize_type);
-    return result;
 }
 
 BlaschkeFFT2::value_type BlaschkeFFT2::ifft(const value_type& mat, size_t out_rows, size_t out_cols, ResizeType resize_type) const {
@@ -29,7 +81,7 @@ BlaschkeFFT2::value_type BlaschkeFFT2::ifft(const value_type& mat, size_t out_ro
     if(out_rows == 0) out_rows = rows;
     if(out_cols == 0) out_cols = cols;
     
-    value_type result(rows, cols);
+    value_type result(rows, cols, value_type::padded_pitch(cols));
     value_type::copy_to(result, mat);
 
     ifft_cols(result, mat.rows(), out_rows, resize_type);
@@ -44,13 +96,24 @@ BlaschkeFFT2::value_type BlaschkeFFT2::ifft(const value_type& mat, size_t out_ro
     return result;
 }
 
+void BlaschkeFFT2::ifft_inplace(value_type& mat, size_t out_rows, size_t out_cols, ResizeType resize_type) const {
+    ASSERT((out_rows <= mat.rows() && out_cols <= mat.cols()), "Output must fit into the transformed data!");
+    ifft_cols(mat, mat.rows(), out_rows, resize_type);
+    ifft_rows(mat, mat.cols(), out_cols, resize_type);
+}
+
 void BlaschkeFFT2::fft_linear_sub_matrix(const BlaschkeFFT& bfft, BlaschkeFFT2::value_type::LinearSubMatrixWrapper sub_matrix, size_t in_size, ResizeType resize_type) const {
-    auto fft_result = bfft.fft(sub_matrix.begin(), sub_matrix.begin() + in_size, resize_type);
+    auto fft_result = line_buffer(0, ceil_pow2(in_size));
+    bfft.fft_to(sub_matrix.begin(), sub_matrix.begin() + in_size, fft_result, resize_type);
     value_type::copy_to(sub_matrix, fft_result.begin(), fft_result.end());
 }
 
 void BlaschkeFFT2::ifft_linear_sub_matrix(const BlaschkeFFT& bfft, value_type::LinearSubMatrixWrapper sub_matrix, size_t in_size, size_t out_size, ResizeType resize_type) const {
-    auto ifft_result = bfft.ifft(sub_matrix.begin(), sub_matrix.begin() + in_size, out_size, resize_type);
+    auto data = line_buffer(0, ceil_pow2(in_size));
+    auto ifft_result = line_buffer(1, out_size == 0 ? data.size() : out_size);
+    std::copy(sub_matrix.begin(), sub_matrix.begin() + in_size, data.begin());
+    std::fill(data.begin() + in_size, data.end(), value_type::value_type(0));
+    bfft.ifft_to(data, ifft_result, resize_type);
     value_type::copy_to(sub_matrix, ifft_result.begin(), ifft_result.end());
 }
 
@@ -67,13 +130,35 @@ void BlaschkeFFT2::ifft_rows(value_type& mat, size_t in_size, size_t out_size, R
 }
 
 void BlaschkeFFT2::fft_cols(value_type& mat, size_t in_size, ResizeType resize_type) const {
-    for(size_t i = 0; i < mat.cols(); i++){
-        fft_linear_sub_matrix(get_col_fft(i), mat.get_col(i), in_size, resize_type);
+    if(mat.rows() < TRANSPOSE_THRESHOLD){
+        for(size_t i = 0; i < mat.cols(); i++){
+            fft_linear_sub_matrix(get_col_fft(i), mat.get_col(i), in_size, resize_type);
+        }
+        return;
     }
+    // long columns are transformed as contiguous rows of the transposed matrix
+    mat.mem_transpose();
+    for(size_t i = 0; i < mat.rows(); i++){
+        fft_linear_sub_matrix(get_col_fft(i), mat.get_row(i), in_size, resize_type);
+    }
+    mat.mem_transpose();
 }
 
 void BlaschkeFFT2::ifft_cols(value_type& mat, size_t in_size, size_t out_size, ResizeType resize_type) const {
-    for(size_t i = 0; i < mat.cols(); i++){
-        ifft_linear_sub_matrix(get_col_fft(i), mat.get_col(i), in_size, out_size, resize_type);
+    if(mat.rows() < TRANSPOSE_THRESHOLD){
+        for(size_t i = 0; i < mat.cols(); i++){
+            ifft_linear_sub_matrix(get_col_fft(i), mat.get_col(i), in_size, out_size, resize_type);
+        }
+        return;
     }
-}
\ No newline at end of file
+    mat.mem_transpose();
+    for(size_t i = 0; i < mat.rows(); i++){
+        ifft_linear_sub_matrix(get_col_fft(i), mat.get_row(i), in_size, out_size, resize_type);
+    }
+    mat.mem_transpose();
+}
+
+BlaschkeFFT2::value_type& bfft::transform_workspace() {
+    thread_local BlaschkeFFT2::value_type transformed(0, 0);
+    return transformed;
+}
@@ -70,10 +70,47 @@ bool FunctionSystem::calc_base_points(size_t __n, const BlaschkeFunction::value_
     return true;
 }
 
+void FunctionSystem::base_points_tangent(size_t __n, size_t lvl, const BlaschkeFunction::value_type& direction,
+                                         std::vector<std::vector<BlaschkeFunction::value_type>>& points,
+                                         std::vector<std::vector<BlaschkeFunction::value_type>>& tangents) const {
+    points.resize(__n + 1);
+    tangents.resize(__n + 1);
+    points[0].assign(1, Complex(1));
+    tangents[0].assign(1, Complex(0));
+    for(size_t i = __n; i > 0; i--){
+        size_t depth = __n - i + 1;
+        size_t root_cnt = 1ul<<depth;
+        points[depth].resize(root_cnt);
+        tangents[depth].resize(root_cnt);
+        BlaschkeFunction::value_type square = at(i - 1).get_param() * at(i - 1).get_param();
+        BlaschkeFunction::value_type square_tangent = i - 1 == lvl ? direction : Complex(0);
+        for(size_t j = 0; j < root_cnt/2; j++){
+            BlaschkeFunction::value_type x = points[depth - 1][j];
+            BlaschkeFunction::value_type x_tangent = tangents[depth - 1][j];
+            auto curr_roots = at(i - 1).get_roots(x);
+            // root^2 = (square + x) / (x * conj(square) + 1)
+            BlaschkeFunction::value_type denominator = Complex::conj_mult(x, square) + 1.0;
+            BlaschkeFunction::value_type root_square = (square + x) / denominator;
+            BlaschkeFunction::value_type root_square_tangent = (square_tangent + x_tangent - root_square * (Complex::conj_mult(x_tangent, square) + Complex::conj_mult(x, square_tangent))) / denominator;
+            points[depth][j] = curr_roots.first;
+            points[depth][j + root_cnt/2] = curr_roots.second;
+            tangents[depth][j] = root_square_tangent / (curr_roots.first * 2.0);
+            tangents[depth][j + root_cnt/2] = -tangents[depth][j];
+        }
+        // same ordering as the base points
+        for(size_t j = 0; j < root_cnt/2 - 1; j++){
+            if((points[depth][j] * Complex::conj(points[depth][j+1])).imag > 0){
+                std::swap(points[depth][j+1], points[depth][root_cnt / 2 + j + 1]);
+                std::swap(tangents[depth][j+1], tangents[depth][root_cnt / 2 + j + 1]);
+            }
+        }
+    }
+}
+
 const std::vector<double>& FunctionSystem::sample_points(size_t n, const BlaschkeFunction::value_type& val) const{
     m_sample_cache_ok = !calc_base_points(n, val) && m_sample_cache_ok;
     if(!m_sample_cache_ok){
-        m_cached_samples = create_sample_points<double>(*this, n, val);
+        create_sample_points_to<double>(*this, n, val, m_cached_samples);
         m_sample_cache_ok = true;
     }
     return m_cached_samples;
@@ -5,9 +5,290 @@
 #include "../include/compression2d.h"
 #include "../include/binary_file_ops.hpp"
 #include "../include/optimizer.h"
+#include "../include/thread_pool.hpp"
 #include <thread>
 #include <future>
+#include <list>
 #include <utility>
+#include <atomic>
+#include <numeric>
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <optional>
+
+namespace {
+
+using BlockList = std::vector<std::pair<bfft::CompressedData2D&, bfft::matrix::SplitComplexView>>;
+
+constexpr size_t NO_BLOCK = static_cast<size_t>(-1);
+// Search of the co-located blocks in the REFINE channel mode, they start next to the parameters of the reference block.
+constexpr size_t REFINE_ITERATIONS = 5;
+constexpr size_t REFINE_SHRINK = 1;
+
+// Runs `fun(i)` for every index below `count` on the threads of the pool, the indices are taken in increasing order.
+// Every worker calls its own copy of `fun`, so a mutable one can keep per worker state.
+template<typename Fun>
+void parallel_for_each(bfft::ThreadPool& pool, size_t count, Fun fun) {
+    std::atomic<size_t> next = 0;
+    std::vector<std::future<void>> workers;
+    for(size_t t = 0; t < std::min(pool.size(), count); t++){
+        workers.push_back(pool.submit([&next, count, fun]() mutable {
+            for(size_t i = next++; i < count; i = next++) fun(i);
+        }));
+    }
+    // every worker is waited for before an exception leaves, they reference the locals
+    std::exception_ptr error;
+    for(auto& worker : workers){
+        try{
+            worker.get();
+        } catch(...){
+            if(!error) error = std::current_exception();
+            next = count;
+        }
+    }
+    if(error) std::rethrow_exception(error);
+}
+
+// Results of the futures in order. Every future is waited for before the first exception is rethrown, so no task
+// outlives the data it references.
+template<typename T>
+std::vector<T> get_all(std::vector<std::future<T>>& futures) {
+    std::vector<T> results;
+    results.reserve(futures.size());
+    std::exception_ptr error;
+    for(auto& future : futures){
+        try{
+            results.push_back(future.get());
+        } catch(...){
+            if(!error) error = std::current_exception();
+        }
+    }
+    if(error) std::rethrow_exception(error);
+    return results;
+}
+
+// The indices in decreasing order of their cost, so the longest blocks don't start at the end. The cost estimate of
+// encoding a block is its variance, flat blocks are skipped or converge fast, textured ones search the longest.
+std::vector<size_t> by_cost(const std::vector<size_t>& indices, const BlockList& blocks) {
+    std::vector<double> costs(indices.size());
+    for(size_t k = 0; k < indices.size(); k++) costs[k] = bfft::block_variance(blocks[indices[k]].second);
+    std::vector<size_t> order(indices.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return costs[a] > costs[b]; });
+    std::vector<size_t> result(indices.size());
+    for(size_t k = 0; k < order.size(); k++) result[k] = indices[order[k]];
+    return result;
+}
+
+bool is_flat(bfft::matrix::SplitComplexView block) {
+    for(size_t i = 0; i < block.rows(); i++){
+        for(size_t j = 0; j < block.cols(); j++){
+            if(!(block.get(i, j) == block.get(0, 0))) return false;
+        }
+    }
+    return true;
+}
+
+// Blocks where no parameter can help noticeably, flat ones are found without a transform.
+bool is_trivial(bfft::matrix::SplitComplexView block, double ratio, bfft::BlaschkeFFT::ResizeType resize_type, double max_error) {
+    if(max_error <= 0) return false;
+    if(is_flat(block)) return true;
+    bfft::BlaschkeFFT2 bfft(block.rows(), block.cols());
+    return bfft::Compressor2D::compression_error(bfft, block, ratio, resize_type) < max_error;
+}
+
+// Full range YCbCr of JPEG on the centered samples of the first three planes, so the chroma planes are centered too.
+void rgb_to_ycbcr(std::vector<bfft::matrix::SplitComplexMatrix>& channels) {
+    auto red = channels[0].real();
+    auto green = channels[1].real();
+    auto blue = channels[2].real();
+    for(size_t i = 0; i < red.rows(); i++){
+        double* r = red[i];
+        double* g = green[i];
+        double* b = blue[i];
+        for(size_t j = 0; j < red.cols(); j++){
+            double y = 0.299 * r[j] + 0.587 * g[j] + 0.114 * b[j];
+            double cb = -0.168736 * r[j] - 0.331264 * g[j] + 0.5 * b[j];
+            double cr = 0.5 * r[j] - 0.418688 * g[j] - 0.081312 * b[j];
+            r[j] = y;
+            g[j] = cb;
+            b[j] = cr;
+        }
+    }
+}
+
+void ycbcr_to_rgb(std::vector<Image::Mat>& channels) {
+    for(size_t i = 0; i < channels[0].rows(); i++){
+        Complex* y = channels[0].view()[i];
+        Complex* cb = channels[1].view()[i];
+        Complex* cr = channels[2].view()[i];
+        for(size_t j = 0; j < channels[0].cols(); j++){
+            double luma = y[j].real;
+            double blue = cb[j].real;
+            double red = cr[j].real;
+            y[j] = Complex(luma + 1.402 * red);
+            cb[j] = Complex(luma - 0.344136 * blue - 0.714136 * red);
+            cr[j] = Complex(luma + 1.772 * blue);
+        }
+    }
+}
+
+// Box average of `factor_rows` x `factor_cols` samples, the partial boxes at the edges average the samples they have.
+bfft::matrix::SplitComplexMatrix downsample(const bfft::matrix::SplitComplexMatrix& plane, size_t factor_rows, size_t factor_cols) {
+    using SplitMat = bfft::matrix::SplitComplexMatrix;
+    size_t rows = (plane.rows() + factor_rows - 1) / factor_rows;
+    size_t cols = (plane.cols() + factor_cols - 1) / factor_cols;
+    SplitMat result(rows, cols, SplitMat::plane_type::padded_pitch(cols));
+    auto source = plane.real();
+    auto target = result.real();
+    for(size_t i = 0; i < rows; i++){
+        double* out = target[i];
+        size_t row_end = std::min(plane.rows(), (i + 1) * factor_rows);
+        for(size_t j = 0; j < cols; j++){
+            size_t col_end = std::min(plane.cols(), (j + 1) * factor_cols);
+            double sum = 0;
+            for(size_t k = i * factor_rows; k < row_end; k++){
+                for(size_t l = j * factor_cols; l < col_end; l++) sum += source[k][l];
+            }
+            out[j] = sum / static_cast<double>((row_end - i * factor_rows) * (col_end - j * factor_cols));
+        }
+    }
+    return result;
+}
+
+// YCbCr planes of RGB channels, the chroma planes are downsampled by the factors.
+void to_color_planes(std::vector<bfft::matrix::SplitComplexMatrix>& channels, size_t factor_rows, size_t factor_cols) {
+    rgb_to_ycbcr(channels);
+    if(factor_rows * factor_cols == 1) return;
+    for(size_t channel = 1; channel <= 2; channel++) channels[channel] = downsample(channels[channel], factor_rows, factor_cols);
+}
+
+// Bilinear interpolation of a plane downsampled by `downsample`, the samples sit at the centres of their boxes.
+Image::Mat upsample(const Image::Mat& plane, size_t rows, size_t cols) {
+    size_t factor_rows = (rows + plane.rows() - 1) / plane.rows();
+    size_t factor_cols = (cols + plane.cols() - 1) / plane.cols();
+    // source position of an output sample, as the two neighbours and the weight of the second one
+    auto neighbours = [](size_t i, size_t factor, size_t size) {
+        double x = std::clamp((static_cast<double>(i) + 0.5) / static_cast<double>(factor) - 0.5, 0.0, static_cast<double>(size - 1));
+        size_t first = static_cast<size_t>(x);
+        return std::tuple<size_t, size_t, double>(first, std::min(first + 1, size - 1), x - static_cast<double>(first));
+    };
+    std::vector<size_t> first_cols(cols), second_cols(cols);
+    std::vector<double> col_weights(cols);
+    for(size_t j = 0; j < cols; j++) std::tie(first_cols[j], second_cols[j], col_weights[j]) = neighbours(j, factor_cols, plane.cols());
+
+    Image::Mat result(rows, cols, Image::Mat::padded_pitch(cols));
+    std::vector<double> line(cols);
+    for(size_t i = 0; i < rows; i++){
+        auto [first, second, weight] = neighbours(i, factor_rows, plane.rows());
+        const Complex* top = plane.view()[first];
+        const Complex* bottom = plane.view()[second];
+        for(size_t j = 0; j < cols; j++) line[j] = (1 - weight) * top[first_cols[j]].real + weight * bottom[first_cols[j]].real;
+        Complex* out = result.view()[i];
+        for(size_t j = 0; j < cols; j++){
+            double right = (1 - weight) * top[second_cols[j]].real + weight * bottom[second_cols[j]].real;
+            out[j] = Complex(line[j] + col_weights[j] * (right - line[j]));
+        }
+    }
+    return result;
+}
+
+// Zero parameter encoding of a trivial block, zero coefficients are dropped, so a flat block keeps only its DC.
+bfft::CompressedData2D compress_trivial(bfft::matrix::SplitComplexView block, double ratio, bfft::BlaschkeFFT::ResizeType resize_type) {
+    bfft::CompressedData2D result = bfft::Compressor2D(block.rows(), block.cols(), ratio, resize_type).compress(block);
+    std::erase_if(result.data, [](const bfft::CompressedData2D::Coefficent& coef) { return coef.value == Complex(0); });
+    return result;
+}
+
+// Moves the codebook parameter sets of the blocks into the channel, each used entry is stored once.
+void share_parameter_sets(std::vector<BlockedData>& channels, const bfft::ParameterCodebook& codebook) {
+    std::map<size_t, size_t> shared;
+    for(BlockedData& channel : channels){
+        for(CompressedBlock& block : channel.blocks){
+            if(block.data.parameter_set == bfft::CompressedData2D::NO_PARAMETER_SET) continue;
+            auto [it, inserted] = shared.try_emplace(block.data.parameter_set, channels[0].parameter_sets.size());
+            if(inserted) channels[0].parameter_sets.push_back(codebook[block.data.parameter_set].parameters);
+            block.data.parameter_set = it->second;
+            block.data.row_params.clear();
+            block.data.col_params.clear();
+        }
+    }
+}
+
+// Blocks with the parameters of their reference block index a single copy of them in `table`, as the reference block does.
+void share_reference_parameters(BlockList& blocks, const std::vector<size_t>& references, BlockedData& table) {
+    std::map<size_t, size_t> shared;
+    for(size_t i = 0; i < blocks.size(); i++){
+        if(references[i] == NO_BLOCK) continue;
+        bfft::CompressedData2D& data = blocks[i].first;
+        const bfft::CompressedData2D& reference = blocks[references[i]].first;
+        if(data.parameter_set != bfft::CompressedData2D::NO_PARAMETER_SET) continue;
+        if(data.row_params != reference.row_params || data.col_params != reference.col_params) continue;
+        auto [it, inserted] = shared.try_emplace(references[i], table.parameter_sets.size());
+        if(inserted) table.parameter_sets.push_back(bfft::ParameterSet{reference.row_params, reference.col_params});
+        data.parameter_set = it->second;
+        data.row_params.clear();
+        data.col_params.clear();
+    }
+    for(auto [reference, parameter_set] : shared){
+        bfft::CompressedData2D& data = blocks[reference].first;
+        data.parameter_set = parameter_set;
+        data.row_params.clear();
+        data.col_params.clear();
+    }
+}
+
+// Parameter set with a system for each of the `rows` rows and `cols` columns, a single shared system is copied to every line.
+bfft::ParameterSet per_line_parameters(const std::vector<std::vector<bfft::BlaschkeFunction::value_type>>& row_params, const std::vector<std::vector<bfft::BlaschkeFunction::value_type>>& col_params, size_t rows, size_t cols) {
+    bfft::ParameterSet result{row_params, col_params};
+    if(row_params.size() == 1) result.row_params.assign(rows, row_params[0]);
+    if(col_params.size() == 1) result.col_params.assign(cols, col_params[0]);
+    return result;
+}
+
+// Every row (column) of a block of the shared mode has the same system, it is stored once.
+void store_shared_systems(BlockList& blocks) {
+    for(auto& block : blocks){
+        if(block.first.parameter_set != bfft::CompressedData2D::NO_PARAMETER_SET) continue;
+        block.first.row_params.resize(1);
+        block.first.col_params.resize(1);
+    }
+}
+
+// Encodes every block with zero parameters (keeping `ratios[i]` of the coefficients of block i), then optimizes the
+// blocks in decreasing order of their error until the deadline of the settings. An optimized block replaces the baseline only if its error is smaller.
+void compress_anytime(bfft::ThreadPool& pool, BlockList& blocks, const std::vector<double>& ratios, bfft::BlaschkeFFT::ResizeType resize_type, const bfft::OptimizerSettings& settings) {
+    std::vector<double> errors(blocks.size());
+    parallel_for_each(pool, blocks.size(), [&](size_t i) {
+        bfft::matrix::SplitComplexView block = blocks[i].second;
+        double ratio = ratios[i];
+        if(settings.skip_error > 0 && is_flat(block)){
+            blocks[i].first = compress_trivial(block, ratio, resize_type);
+            return;
+        }
+        bfft::BlaschkeFFT2 bfft(block.rows(), block.cols());
+        blocks[i].first = bfft::Compressor2D(bfft, ratio, resize_type).compress(block);
+        errors[i] = bfft::Compressor2D::compression_error(bfft, block, ratio, resize_type);
+    });
+
+    std::vector<size_t> order(blocks.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return errors[a] > errors[b]; });
+
+    parallel_for_each(pool, order.size(), [&](size_t k) {
+        if(std::chrono::steady_clock::now() >= settings.deadline) return;
+        bfft::matrix::SplitComplexView block = blocks[order[k]].second;
+        double ratio = ratios[order[k]];
+        if(errors[order[k]] < settings.skip_error) return;
+        bfft::BlaschkeFFT2 bfft = bfft::optimize_blaschke_fft(block, ratio, resize_type, settings);
+        if(bfft::Compressor2D::compression_error(bfft, block, ratio, resize_type) < errors[order[k]]){
+            blocks[order[k]].first = bfft::Compressor2D(bfft, ratio, resize_type).compress(block);
+        }
+    });
+}
+
+}
 
 Image::Image(const std::filesystem::path& path, int read_channels){
     ASSERT((0 <= read_channels && read_channels <= 4), "Channels count must be in range [1, 4]!");
@@ -38,16 +319,54 @@ Image::Image(const std::vector<Mat>& channels) {
     }
 }
 
-std::vector<Image::Mat> Image::decompress(const std::vector<BlockedData>& channels){
-    std::vector<Mat> data(channels.size(), Mat(channels[0].rows, channels[0].cols));
-    bfft::Compressor2D compressor(1, 1, 1.0, bfft::BlaschkeFFT::ResizeType::RESIZE);
+std::vector<Image::Mat> Image::decompress(const std::vector<BlockedData>& channels, size_t threads){
+    std::vector<Mat> data;
+    for(const BlockedData& channel : channels) data.emplace_back(channel.rows, channel.cols, Mat::padded_pitch(channel.cols));
+    // the blocks index the parameter sets of every channel, in channel order
+    std::vector<const bfft::ParameterSet*> parameter_sets;
+    for(const BlockedData& channel : channels){
+        for(const bfft::ParameterSet& parameters : channel.parameter_sets) parameter_sets.push_back(&parameters);
+    }
+    std::vector<std::pair<size_t, const CompressedBlock*>> blocks;
     for(size_t channel = 0; channel < channels.size(); channel++){
         for(const CompressedBlock& block : channels[channel].blocks){
-            Mat block_mat = compressor.decompress(block.data);
-            //No need to resize block, because only edges can be too big
-            Mat::copy_to_pos(data[channel], block_mat, block.offset_row, block.offset_col);
+            size_t parameter_set = block.data.parameter_set;
+            if(parameter_set != bfft::CompressedData2D::NO_PARAMETER_SET){
+                ERROR(parameter_set < parameter_sets.size(), "Failed to decompress! (Missing parameter set.)");
+            }
+            blocks.emplace_back(channel, &block);
         }
     }
+
+    // The blocks cover disjoint regions of the planes. The stored parameters are decoded with fresh systems, but the
+    // function systems cache their base points, so every worker decodes the shared parameter sets with its own
+    // compressors, created on first use.
+    const bfft::Compressor2D compressor(1, 1, 1.0, bfft::BlaschkeFFT::ResizeType::RESIZE);
+    bfft::ThreadPool pool(threads);
+    parallel_for_each(pool, blocks.size(), [&data, &blocks, &parameter_sets, &compressor, compressors = std::vector<std::optional<bfft::Compressor2D>>(parameter_sets.size())](size_t k) mutable {
+        auto [channel, block] = blocks[k];
+        size_t parameter_set = block->data.parameter_set;
+        bfft::matrix::Matrix<Complex> block_mat(0, 0);
+        if(parameter_set == bfft::CompressedData2D::NO_PARAMETER_SET){
+            block_mat = compressor.decompress(block->data);
+        } else{
+            if(!compressors[parameter_set]){
+                const bfft::ParameterSet& parameters = *parameter_sets[parameter_set];
+                compressors[parameter_set].emplace(per_line_parameters(parameters.row_params, parameters.col_params, block->data.result_rows, block->data.result_cols).make_bfft(), 1.0);
+            }
+            block_mat = compressors[parameter_set]->this_decompress(block->data);
+        }
+        //No need to resize block, because only edges can be too big
+        Mat::copy_to_pos(data[channel].view(), block_mat, block->offset_row, block->offset_col);
+    });
+
+    if(channels.size() >= 3 && channels[0].plane == LUMA){
+        ERROR((channels[1].plane == CHROMA_BLUE && channels[2].plane == CHROMA_RED), "Failed to decompress! (Missing chroma planes.)");
+        for(size_t channel = 1; channel <= 2; channel++){
+            if(data[channel].rows() != data[0].rows() || data[channel].cols() != data[0].cols()) data[channel] = upsample(data[channel], data[0].rows(), data[0].cols());
+        }
+        ycbcr_to_rgb(data);
+    }
     return data;
 }
 
@@ -56,7 +375,7 @@ Image::~Image() {
 }
 
 std::vector<Image::Mat> Image::convert_to_mat() {
-    std::vector<Mat> result(m_channels, Mat(m_height, m_width));
+    std::vector<Mat> result(m_channels, Mat(m_height, m_width, Mat::padded_pitch(m_width)));
     for(int i = 0; i < m_height; i++){
         for(int j = 0; j < m_width; j++){
             for(int channel = 0; channel < m_channels; channel++){
@@ -68,50 +387,220 @@ std::vector<Image::Mat> Image::convert_to_mat() {
     return result;
 }
 
-std::vector<BlockedData> Image::compress(double ratio, bfft::BlaschkeFFT::ResizeType resize_type, bfft::OptimizerOpt optimizer_opt, size_t block_size, size_t max_iteration, size_t max_shrink) {
-    std::vector<Mat> channels = convert_to_mat();
+std::vector<bfft::matrix::SplitComplexMatrix> Image::convert_to_split_mat() {
+    using SplitMat = bfft::matrix::SplitComplexMatrix;
+    std::vector<SplitMat> result(m_channels, SplitMat(m_height, m_width, SplitMat::plane_type::padded_pitch(m_width)));
+    for(int channel = 0; channel < m_channels; channel++){
+        auto plane = result[channel].real();
+        for(int i = 0; i < m_height; i++){
+            for(int j = 0; j < m_width; j++){
+                int idx = (i * m_width + j) * m_channels + channel;
+                plane[i][j] = static_cast<double>(m_image_ptr[idx] - 128);
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<bfft::ParameterCodebook::Entry> Image::codebook_samples(const std::vector<BlockedData>& channels, bool channel_reuse) {
+    using SplitMat = bfft::matrix::SplitComplexMatrix;
+    std::vector<SplitMat> source = convert_to_split_mat();
+    if(channels.size() >= 3 && channels[0].plane == LUMA){
+        to_color_planes(source, (channels[0].rows + channels[1].rows - 1) / channels[1].rows, (channels[0].cols + channels[1].cols - 1) / channels[1].cols);
+    }
+    // the blocks index the parameter sets of every channel, in channel order
+    std::vector<const bfft::ParameterSet*> parameter_sets;
+    for(const BlockedData& channel : channels){
+        for(const bfft::ParameterSet& parameters : channel.parameter_sets) parameter_sets.push_back(&parameters);
+    }
+    std::vector<bool> sampled(parameter_sets.size(), false);
+    std::vector<bfft::ParameterCodebook::Entry> samples;
+    for(size_t channel = 0; channel < channels.size(); channel++){
+        for(const CompressedBlock& block : channels[channel].blocks){
+            const bfft::CompressedData2D& data = block.data;
+            const auto* row_params = &data.row_params;
+            const auto* col_params = &data.col_params;
+            if(data.parameter_set != bfft::CompressedData2D::NO_PARAMETER_SET){
+                // a set is either a codebook entry or the parameters of a reference block, sampled at its first block
+                if(!channel_reuse || data.parameter_set >= parameter_sets.size() || sampled[data.parameter_set]) continue;
+                sampled[data.parameter_set] = true;
+                row_params = &parameter_sets[data.parameter_set]->row_params;
+                col_params = &parameter_sets[data.parameter_set]->col_params;
+            }
+            // edge blocks are zero padded, as they were compressed
+            SplitMat block_mat = SplitMat::submatrix_from_pos(source[channel], block.offset_row, block.offset_col, data.result_rows, data.result_cols);
+            samples.push_back(bfft::ParameterCodebook::Entry{per_line_parameters(*row_params, *col_params, data.result_rows, data.result_cols), bfft::block_features(block_mat)});
+        }
+    }
+    return samples;
+}
+
+std::vector<BlockedData> Image::compress(double ratio, bfft::BlaschkeFFT::ResizeType resize_type, bfft::OptimizerOpt optimizer_opt, size_t block_size, const bfft::OptimizerSettings& settings, const bfft::ParameterCodebook* codebook, const ColorSettings& color) {
+    using SplitMat = bfft::matrix::SplitComplexMatrix;
+    std::vector<SplitMat> channels = convert_to_split_mat();
     std::vector<BlockedData> compressed_channels(channels.size());
-    
-    std::vector<std::pair<bfft::CompressedData2D&, Mat>> blocks;
-    // std::vector<Mat> blocks;
+    std::vector<double> plane_ratios(channels.size(), ratio);
+
+    // the alpha channel stays a plain plane
+    if(color.ycbcr && channels.size() >= 3){
+        to_color_planes(channels, color.subsampling == CHROMA_420 ? 2 : 1, color.subsampling == CHROMA_444 ? 1 : 2);
+        compressed_channels[0].plane = LUMA;
+        compressed_channels[1].plane = CHROMA_BLUE;
+        compressed_channels[2].plane = CHROMA_RED;
+        if(color.chroma_ratio > 0) plane_ratios[1] = plane_ratios[2] = color.chroma_ratio;
+    }
+
+    // With channel reuse the first channel is the reference plane, it is encoded before the other channels. Subsampled
+    // planes have no co-located blocks.
+    bool same_size = std::all_of(channels.begin(), channels.end(), [&](const SplitMat& plane) { return plane.rows() == channels[0].rows() && plane.cols() == channels[0].cols(); });
+    bool reuse = settings.channels != bfft::ChannelType::SEPARATE && channels.size() > 1 && same_size && optimizer_opt != bfft::OptimizerOpt::NO_OPTIMIZE && codebook == nullptr;
+
+    BlockList blocks;
+    // Wavefront of each block, the indices of its left and top neighbours and of its co-located reference block (`NO_BLOCK` if there is none).
+    std::vector<size_t> block_waves;
+    std::vector<std::pair<size_t, size_t>> neighbours;
+    std::vector<size_t> references;
+    std::vector<double> block_ratios;
+    // Blocks on the right and bottom edges are zero padded to full size, only these are copied.
+    std::list<SplitMat> edge_blocks;
+    // Adds the blocks of a plane into the storage returned by `store`, the index of the first one is returned.
+    // The blocks keep `plane_ratio` of their coefficients.
+    auto add_plane = [&](const SplitMat& plane, double plane_ratio, auto store, size_t first_reference) {
+        size_t first = blocks.size();
+        size_t block_cols = (plane.cols() + block_size - 1) / block_size;
+        for(size_t i = 0; i < plane.rows(); i += block_size){
+            for(size_t j = 0; j < plane.cols(); j += block_size){
+                bfft::matrix::SplitComplexView block_view = plane.view().subview(i, j, block_size, block_size);
+                size_t rows = block_view.rows();
+                size_t cols = block_view.cols();
+                if(rows != block_size || cols != block_size){
+                    edge_blocks.push_back(SplitMat::submatrix_from_pos(plane, i, j, block_size, block_size));
+                    block_view = edge_blocks.back();
+                }
+
+                blocks.emplace_back(store(i, j, rows, cols), block_view);
+                block_waves.push_back(i / block_size + j / block_size);
+                neighbours.emplace_back(j > 0 ? blocks.size() - 2 : NO_BLOCK, i > 0 ? blocks.size() - 1 - block_cols : NO_BLOCK);
+                references.push_back(first_reference == NO_BLOCK ? NO_BLOCK : first_reference + blocks.size() - 1 - first);
+                block_ratios.push_back(plane_ratio);
+            }
+        }
+        return first;
+    };
+
+    size_t first_reference = NO_BLOCK;
     for(size_t channel = 0; channel < channels.size(); channel++){
         compressed_channels[channel].rows = channels[channel].rows();
         compressed_channels[channel].cols = channels[channel].cols();
         
         compressed_channels[channel].blocks.reserve((channels[channel].rows() / block_size + 1) * (channels[channel].cols() / block_size + 1));
         
-        for(size_t i = 0; i < channels[channel].rows(); i += block_size){
-            for(size_t j = 0; j < channels[channel].cols(); j += block_size){
-                Mat block_mat = Mat::submatrix_from_pos(channels[channel], i, j, block_size, block_size);
-                size_t rows = std::min(block_size, channels[channel].rows() - i);
-                size_t cols = std::min(block_size, channels[channel].cols() - j);
-                
-                compressed_channels[channel].blocks.push_back(CompressedBlock{i, j, rows, cols, bfft::CompressedData2D{}});
-                blocks.emplace_back(compressed_channels[channel].blocks.back().data, block_mat);
-            }
-        }
+        size_t first = add_plane(channels[channel], plane_ratios[channel], [&](size_t i, size_t j, size_t rows, size_t cols) -> bfft::CompressedData2D& {
+            compressed_channels[channel].blocks.push_back(CompressedBlock{i, j, rows, cols, bfft::CompressedData2D{}});
+            return compressed_channels[channel].blocks.back().data;
+        }, first_reference);
+        if(reuse && channel == 0) first_reference = first;
     }
 
-    auto compress_block = [optimizer_opt, ratio, resize_type, max_iteration, max_shrink](Mat block) -> bfft::CompressedData2D {
+    // Declared after the block data, so the queued tasks are finished before it is destroyed.
+    bfft::ThreadPool pool(settings.threads);
+
+    // the sample grids are split among the idle workers of the pool, so once the last blocks are running
+    bfft::OptimizerSettings block_settings = settings;
+    block_settings.method = optimizer_opt;
+    if(block_settings.grid_threads == 0) block_settings.grid_threads = pool.size();
+
+    auto compress_block = [optimizer_opt, resize_type, codebook](bfft::matrix::SplitComplexView block, double ratio, bfft::OptimizerSettings settings, bfft::WarmStart warm_start) -> bfft::CompressedData2D {
+        if((optimizer_opt != bfft::OptimizerOpt::NO_OPTIMIZE || codebook != nullptr) && is_trivial(block, ratio, resize_type, settings.skip_error)) return compress_trivial(block, ratio, resize_type);
+        if(codebook != nullptr){
+            size_t entry = codebook->choose(block, ratio, resize_type);
+            bfft::BlaschkeFFT2 bfft = entry == bfft::ParameterCodebook::NO_ENTRY ? bfft::BlaschkeFFT2(block.rows(), block.cols()) : (*codebook)[entry].parameters.make_bfft();
+            bfft::CompressedData2D result = bfft::Compressor2D(bfft, ratio, resize_type).compress(block);
+            if(entry != bfft::ParameterCodebook::NO_ENTRY) result.parameter_set = entry;
+            return result;
+        }
+        // the parameters of the reference block are kept only if they beat zero on the channel
+        if(settings.channels == bfft::ChannelType::REUSE && warm_start.channel != nullptr){
+            bfft::BlaschkeFFT2 bfft = bfft::ParameterSet{warm_start.channel->row_params, warm_start.channel->col_params}.make_bfft();
+            bfft::BlaschkeFFT2 zero(block.rows(), block.cols());
+            if(bfft::Compressor2D::compression_error(zero, block, ratio, resize_type) <= bfft::Compressor2D::compression_error(bfft, block, ratio, resize_type)) bfft = zero;
+            return bfft::Compressor2D(bfft, ratio, resize_type).compress(block);
+        }
         bfft::BlaschkeFFT2 bfft(block.rows(), block.cols());
-        if(optimizer_opt == bfft::OptimizerOpt::NELDER_MEAD) bfft = bfft::optimize_blaschke_fft(block, ratio, resize_type, max_iteration, max_shrink);
+        if(optimizer_opt != bfft::OptimizerOpt::NO_OPTIMIZE) bfft = bfft::optimize_blaschke_fft(block, ratio, resize_type, settings, warm_start);
         bfft::CompressedData2D result = bfft::Compressor2D(bfft, ratio, resize_type).compress(block);
         return result;
     };
 
-    std::vector<std::future<bfft::CompressedData2D>> task_list;
-
+    // the reference blocks first, then the co-located blocks of the channels in a single wave
+    std::vector<size_t> dependents;
     for(size_t i = 0; i < blocks.size(); i++){
-        task_list.push_back(std::async(std::launch::async, compress_block, blocks[i].second));
+        if(references[i] != NO_BLOCK) dependents.push_back(i);
     }
+    auto compress_dependents = [&]() {
+        bfft::OptimizerSettings dependent_settings = block_settings;
+        dependent_settings.max_iterations = std::min(dependent_settings.max_iterations, REFINE_ITERATIONS);
+        dependent_settings.max_shrink = std::min(dependent_settings.max_shrink, REFINE_SHRINK);
+        std::vector<size_t> order = by_cost(dependents, blocks);
+        std::vector<std::future<bfft::CompressedData2D>> task_list;
+        for(size_t i : order){
+            bfft::WarmStart warm_start;
+            warm_start.channel = &blocks[references[i]].first;
+            task_list.push_back(pool.submit([&compress_block, block = blocks[i].second, ratio = block_ratios[i], dependent_settings, warm_start]() { return compress_block(block, ratio, dependent_settings, warm_start); }));
+        }
+        std::vector<bfft::CompressedData2D> results = get_all(task_list);
+        for(size_t k = 0; k < order.size(); k++){
+            blocks[order[k]].first = std::move(results[k]);
+        }
+        // the shared systems are collapsed first, so the shared sets store them once too
+        if(settings.sharing == bfft::SharingType::SHARED) store_shared_systems(blocks);
+        share_reference_parameters(blocks, references, compressed_channels[0]);
+    };
 
-    try{
+    // with a deadline the blocks are optimized in the order of their error, so without the warm start
+    if(codebook == nullptr && optimizer_opt != bfft::OptimizerOpt::NO_OPTIMIZE && settings.deadline != std::chrono::steady_clock::time_point::max()){
+        BlockList reference_blocks;
+        std::vector<double> reference_ratios;
         for(size_t i = 0; i < blocks.size(); i++){
-            blocks[i].first = task_list[i].get();
+            if(references[i] != NO_BLOCK) continue;
+            reference_blocks.emplace_back(blocks[i].first, blocks[i].second);
+            reference_ratios.push_back(block_ratios[i]);
         }
-    } catch(const std::exception& e){
-        std::cout << "Error while waiting for blocks to be compressed: " << e.what() << std::endl;
-        std::abort();
+        compress_anytime(pool, reference_blocks, reference_ratios, resize_type, block_settings);
+        if(reuse) compress_dependents();
+        if(settings.sharing == bfft::SharingType::SHARED) store_shared_systems(blocks);
+        return compressed_channels;
+    }
+
+    // A block of a wave only depends on blocks of the previous waves, without the warm start every block is in one wave.
+    bool warm = settings.start == bfft::StartType::NEIGHBOURS && optimizer_opt != bfft::OptimizerOpt::NO_OPTIMIZE && codebook == nullptr;
+    std::vector<std::vector<size_t>> waves(1);
+    for(size_t i = 0; i < blocks.size(); i++){
+        if(references[i] != NO_BLOCK) continue;
+        size_t wave = warm ? block_waves[i] : 0;
+        if(waves.size() <= wave) waves.resize(wave + 1);
+        waves[wave].push_back(i);
+    }
+
+    for(const auto& wave : waves){
+        std::vector<size_t> order = by_cost(wave, blocks);
+        std::vector<std::future<bfft::CompressedData2D>> task_list;
+        for(size_t i : order){
+            bfft::WarmStart warm_start;
+            if(warm && neighbours[i].first != NO_BLOCK) warm_start.left = &blocks[neighbours[i].first].first;
+            if(warm && neighbours[i].second != NO_BLOCK) warm_start.top = &blocks[neighbours[i].second].first;
+            task_list.push_back(pool.submit([&compress_block, block = blocks[i].second, ratio = block_ratios[i], &block_settings, warm_start]() { return compress_block(block, ratio, block_settings, warm_start); }));
+        }
+        std::vector<bfft::CompressedData2D> results = get_all(task_list);
+        for(size_t k = 0; k < order.size(); k++){
+            blocks[order[k]].first = std::move(results[k]);
+        }
+    }
+    if(reuse) compress_dependents();
+
+    if(settings.sharing == bfft::SharingType::SHARED) store_shared_systems(blocks);
+    if(codebook != nullptr){
+        share_parameter_sets(compressed_channels, *codebook);
     }
 
     return compressed_channels;
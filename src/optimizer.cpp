@@ -2,27 +2,143 @@
 #include "../include/compression.h"
 #include "../include/compression2d.h"
 #include "../include/nelder_mead.hpp"
+#include "../include/quasi_newton.hpp"
+#include "../include/coefficient_selector.h"
+#include "../include/thread_pool.hpp"
 
 #include <utility>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <numeric>
+#include <algorithm>
 
 using namespace bfft;
 
+namespace {
+
+// Per thread buffers of the objectives.
+std::span<BlaschkeFFT::value_type> line_workspace(size_t n) {
+    thread_local std::vector<BlaschkeFFT::value_type> buffer;
+    if(buffer.size() < n) buffer.resize(n);
+    return std::span<BlaschkeFFT::value_type>(buffer.data(), n);
+}
+
+// Per thread buffers of the gradients, a transformed line and its derivatives along the real and imaginary direction.
+std::span<BlaschkeFFT::value_type> gradient_workspace(size_t slot, size_t n) {
+    thread_local std::vector<BlaschkeFFT::value_type> buffers[3];
+    if(buffers[slot].size() < n) buffers[slot].resize(n);
+    return std::span<BlaschkeFFT::value_type>(buffers[slot].data(), n);
+}
+
+// Transforms a line into slot 0 and its derivatives with respect to the square of the `lvl` parameter into slot 1 and 2.
+template<typename InputIterator>
+void line_gradient(const BlaschkeFFT& bfft, InputIterator first, InputIterator last, size_t lvl, BlaschkeFFT::ResizeType resize_type) {
+    size_t n = ceil_pow2(static_cast<size_t>(std::distance(first, last)));
+    bfft.fft_tangent_to(first, last, lvl, Complex(1), gradient_workspace(0, n), gradient_workspace(1, n), resize_type);
+    bfft.fft_tangent_to(first, last, lvl, Complex(0, 1), gradient_workspace(0, n), gradient_workspace(2, n), resize_type);
+}
+
+// Root of the energy of the dropped coefficients (as the truncation error estimates) and its gradient. `coef(k)` is
+// the k-th coefficient in row-major order and `tangent(d, k)` its derivative along the d-th direction.
+template<typename Coef, typename Tangent>
+double dropped_energy_gradient(size_t count, double ratio, Coef coef, Tangent tangent, std::array<double, 2>& gradient) {
+    size_t split = std::min(static_cast<size_t>(static_cast<double>(count) * ratio), count);
+    CoefficientSelector& selector = CoefficientSelector::local();
+    std::span<double> magnitudes = selector.reset(count);
+    for(size_t k = 0; k < count; k++) magnitudes[k] = Complex::abs(coef(k));
+    selector.partition(split);
+
+    double energy = 0;
+    std::array<double, 2> energy_gradient{};
+    for(size_t k : selector.indices().subspan(split)){
+        Complex value = coef(k);
+        energy += Complex::norm(value);
+        for(size_t d = 0; d < 2; d++) energy_gradient[d] += 2 * Complex::conj_mult(tangent(d, k), value).real;
+    }
+    double error = std::sqrt(energy);
+    for(size_t d = 0; d < 2; d++) gradient[d] = error > 0 ? energy_gradient[d] / (2 * error) : 0;
+    return error;
+}
+
+}
+
 double OptimizerFun1D::operator()(const std::valarray<double> &args) const {
     ASSERT((args.size() == argc()), "Argumentum counts must mach!");
-    BlaschkeFFT bfft(m_bfft);
 
     double angle = args[0];
     double radius = std::clamp(args[1], -0.99, 0.99); // radius required to be in (-1, 1), radius close to 1 is not optimal
 
-    bfft.function_system().set_function(m_lvl, Complex::polar(radius, angle));
+    m_bfft->function_system().set_function(m_lvl, Complex::polar(radius, angle));
+
+    if(m_objective == ObjectiveType::TRANSFORM_PROXY) return Compressor1D::truncation_error_estimate(*m_bfft, m_data, m_ratio, m_resize_type);
+    return Compressor1D::compression_error(*m_bfft, m_data, m_ratio, m_resize_type);
+}
+
+double OptimizerFun1D::truncation_gradient(BlaschkeFunction::value_type square, std::array<double, 2>& gradient) const {
+    m_bfft->function_system().set_function(m_lvl, Complex::sqrt(square));
+    line_gradient(*m_bfft, m_data.begin(), m_data.end(), m_lvl, m_resize_type);
 
-    Compressor1D compressor(bfft, m_ratio, m_resize_type);
-    return compressor.compression_error(m_data);
+    size_t n = ceil_pow2(m_data.size());
+    auto transformed = gradient_workspace(0, n);
+    std::span<BlaschkeFFT::value_type> tangents[2] = {gradient_workspace(1, n), gradient_workspace(2, n)};
+    return dropped_energy_gradient(n, m_ratio, [&](size_t k) { return transformed[k]; }, [&](size_t d, size_t k) { return tangents[d][k]; }, gradient);
+}
+
+template<typename View>
+OptimizerFun2D<View>::OptimizerFun2D(ConstView data, BlaschkeFFT2 &bfft, size_t idx, size_t lvl, OptType type, double ratio,
+                                     BlaschkeFFT::ResizeType resize_type, ObjectiveType objective, EvaluationType evaluation)
+    : m_data(data), m_bfft(bfft), m_idx(idx), m_lvl(lvl), m_type(type), m_ratio(ratio), m_resize_type(resize_type), m_objective(objective)
+{
+    if(evaluation == EvaluationType::FULL || type == OptType::ROWS || type == OptType::COLS) return;
+
+    const BlaschkeFFT2& system = bfft;
+    BlaschkeFFT2::value_type input = BlaschkeFFT2::load(data);
+    BlaschkeFFT2::value_type row_pass(input);
+    system.fft_rows(row_pass, data.cols(), resize_type);
+    BlaschkeFFT2::value_type transformed(row_pass);
+    system.fft_cols(transformed, data.rows(), resize_type);
+
+    BlaschkeFFT2::value_type response(0, 0);
+    if(type == OptType::ROW){
+        // every column transform is linear, so a change of the row is scaled by the column's impulse response
+        response = BlaschkeFFT2::value_type(transformed.rows(), transformed.cols(), BlaschkeFFT2::value_type::padded_pitch(transformed.cols()));
+        std::vector<BlaschkeFFT::value_type> impulse(data.rows(), BlaschkeFFT::value_type(0));
+        impulse[idx] = BlaschkeFFT::value_type(1);
+        for(size_t j = 0; j < transformed.cols(); j++){
+            auto column = system.get_col_fft(j).fft(impulse, resize_type);
+            for(size_t i = 0; i < transformed.rows(); i++) response[i][j] = column[i];
+        }
+    }
+    m_cache = std::make_shared<const IncrementalCache>(IncrementalCache{std::move(input), std::move(row_pass), std::move(transformed), std::move(response)});
 }
 
-double OptimizerFun2D::operator()(const std::valarray<double> &args) const {
+template<typename View>
+void OptimizerFun2D<View>::incremental_transform(BlaschkeFFT2::value_type& transformed) const {
+    transformed = m_cache->transformed;
+    if(m_type == OptType::ROW){
+        auto row = m_cache->input.get_row(m_idx);
+        auto row_result = line_workspace(transformed.cols());
+        m_bfft->get_row_fft(m_idx).fft_to(row.begin(), row.begin() + m_data.cols(), row_result, m_resize_type);
+        auto previous = m_cache->row_pass.get_row(m_idx);
+        for(size_t j = 0; j < row_result.size(); j++) row_result[j] -= previous[j];
+        for(size_t i = 0; i < transformed.rows(); i++){
+            auto response = m_cache->response.get_row(i);
+            auto result = transformed.get_row(i);
+            for(size_t j = 0; j < row_result.size(); j++) result[j] += response[j] * row_result[j];
+        }
+    } else {
+        auto col = m_cache->row_pass.get_col(m_idx);
+        auto col_result = line_workspace(transformed.rows());
+        m_bfft->get_col_fft(m_idx).fft_to(col.begin(), col.begin() + m_data.rows(), col_result, m_resize_type);
+        BlaschkeFFT2::value_type::copy_to(transformed.get_col(m_idx), col_result.begin(), col_result.end());
+    }
+}
+
+template<typename View>
+double OptimizerFun2D<View>::operator()(const std::valarray<double> &args) const {
     ASSERT((args.size() == argc()), "Argumentum counts must mach!");
-    // BlaschkeFFT2 bfft(m_bfft);
 
     //if too close to border shouldn't be optimal
     if(std::abs(args[1]) > 0.98){
@@ -32,18 +148,394 @@ double OptimizerFun2D::operator()(const std::valarray<double> &args) const {
     double angle = args[0];
     double radius = std::clamp(args[1], -0.99, 0.99); // radius required to be in (-1, 1), radius close to 1 is not optimal
 
+    Complex param = Complex::polar(radius, angle);
     if(m_type == OptType::ROW){
-        m_bfft.get_row_fft(m_idx).function_system().set_function(m_lvl, Complex::polar(radius, angle));
+        m_bfft->get_row_fft(m_idx).function_system().set_function(m_lvl, param);
+    } else if(m_type == OptType::COL){
+        m_bfft->get_col_fft(m_idx).function_system().set_function(m_lvl, param);
+    } else if(m_type == OptType::ROWS){
+        for(size_t i = 0; i < m_bfft->rows(); i++) m_bfft->get_row_fft(i).function_system().set_function(m_lvl, param);
     } else {
-        m_bfft.get_col_fft(m_idx).function_system().set_function(m_lvl, Complex::polar(radius, angle));
+        for(size_t i = 0; i < m_bfft->cols(); i++) m_bfft->get_col_fft(i).function_system().set_function(m_lvl, param);
+    }
+
+    if(m_cache){
+        BlaschkeFFT2::value_type& transformed = transform_workspace();
+        incremental_transform(transformed);
+        if(m_objective == ObjectiveType::TRANSFORM_PROXY) return Compressor2D::transformed_truncation_error_estimate(transformed, m_ratio);
+        return Compressor2D::transformed_compression_error(*m_bfft, m_data, transformed, m_ratio, m_resize_type);
+    }
+
+    if(m_objective == ObjectiveType::TRANSFORM_PROXY) return Compressor2D::truncation_error_estimate(*m_bfft, m_data, m_ratio, m_resize_type);
+    return Compressor2D::compression_error(*m_bfft, m_data, m_ratio, m_resize_type);
+}
+
+template<typename View>
+double OptimizerFun2D<View>::truncation_gradient(BlaschkeFunction::value_type square, std::array<double, 2>& gradient) const {
+    ASSERT(m_cache != nullptr, "The gradient requires the incremental evaluation!");
+
+    BlaschkeFFT2::value_type& transformed = transform_workspace();
+    size_t cols = m_cache->transformed.cols();
+    if(m_type == OptType::ROW){
+        m_bfft->get_row_fft(m_idx).function_system().set_function(m_lvl, Complex::sqrt(square));
+        incremental_transform(transformed);
+        // the column pass is linear, the change of the row is scaled by the impulse responses
+        auto row = m_cache->input.get_row(m_idx);
+        line_gradient(m_bfft->get_row_fft(m_idx), row.begin(), row.begin() + m_data.cols(), m_lvl, m_resize_type);
+        std::span<BlaschkeFFT::value_type> tangents[2] = {gradient_workspace(1, cols), gradient_workspace(2, cols)};
+        return dropped_energy_gradient(transformed.rows() * cols, m_ratio,
+            [&](size_t k) { return transformed[k / cols][k % cols]; },
+            [&](size_t d, size_t k) { return m_cache->response[k / cols][k % cols] * tangents[d][k % cols]; }, gradient);
     }
 
-    // return compressor.compression_error(m_data);
-    // faster with no copy
-    return Compressor2D::compression_error(m_bfft, m_data, m_ratio, m_resize_type);
+    m_bfft->get_col_fft(m_idx).function_system().set_function(m_lvl, Complex::sqrt(square));
+    incremental_transform(transformed);
+    // only the optimized column changes
+    auto col = m_cache->row_pass.get_col(m_idx);
+    line_gradient(m_bfft->get_col_fft(m_idx), col.begin(), col.begin() + m_data.rows(), m_lvl, m_resize_type);
+    std::span<BlaschkeFFT::value_type> tangents[2] = {gradient_workspace(1, transformed.rows()), gradient_workspace(2, transformed.rows())};
+    return dropped_energy_gradient(transformed.rows() * cols, m_ratio,
+        [&](size_t k) { return transformed[k / cols][k % cols]; },
+        [&](size_t d, size_t k) { return k % cols == m_idx ? tangents[d][k / cols] : BlaschkeFFT::value_type(0); }, gradient);
+}
+
+template class bfft::OptimizerFun2D<matrix::ConstMatrixView<BlaschkeFFT::value_type>>;
+template class bfft::OptimizerFun2D<matrix::SplitComplexView>;
+
+namespace {
+
+size_t thread_count(size_t requested){
+    return requested == 0 ? std::max(1u, std::thread::hardware_concurrency()) : requested;
 }
 
-BlaschkeFFT bfft::optimize_blaschke_fft(const std::vector<BlaschkeFFT::value_type>& data, double ratio, BlaschkeFFT::ResizeType resize_type, size_t max_iterations, size_t max_shrink, size_t sample_radius, size_t sample_angle){
+// Polar grid of `angles` x `radii` points in [0, pi) x (0, max_radius] and the origin, refined `rounds` times around
+// the `keep` best points. BlaschkeFunction depends only on the square of its parameter, so [0, pi) covers every angle.
+struct PolarGrid{
+    size_t angles;
+    size_t radii;
+    double max_radius;
+    size_t keep;
+    size_t rounds;
+};
+
+// Evaluates the points on per-thread copies of the function, the values are in the order of the points. On a worker
+// of a thread pool the parts are stolen by the idle workers, so a block is split only once the other blocks are done.
+template<typename Fun>
+std::vector<double> evaluate_points(const Fun& opt_fun, const std::vector<std::valarray<double>>& points, size_t threads){
+    std::vector<double> values(points.size());
+    ThreadPool* pool = ThreadPool::current();
+    if(pool != nullptr) threads = std::min(threads, pool->idle() + 1);
+    threads = std::min(threads, points.size());
+    if(threads <= 1){
+        for(size_t i = 0; i < points.size(); i++) values[i] = opt_fun(points[i]);
+        return values;
+    }
+    auto part = [&values, &points, threads](size_t t, const Fun& fun) {
+        for(size_t i = t; i < points.size(); i += threads) values[i] = fun(points[i]);
+    };
+    std::vector<std::future<void>> tasks;
+    std::exception_ptr error;
+    try{
+        for(size_t t = 1; t < threads; t++){
+            if(pool != nullptr) tasks.push_back(pool->submit([part, t, fun = opt_fun]() { part(t, fun); }));
+            else tasks.push_back(std::async(std::launch::async, part, t, opt_fun));
+        }
+        part(0, opt_fun);
+    } catch(...){
+        error = std::current_exception();
+    }
+    ThreadPool::wait_all(pool, tasks, error);
+    return values;
+}
+
+// Index of the smallest value, ties resolve to the first one as in a serial scan.
+size_t first_min(const std::vector<double>& values){
+    size_t best = 0;
+    for(size_t i = 1; i < values.size(); i++){
+        if(values[i] < values[best]) best = i;
+    }
+    return best;
+}
+
+std::atomic<size_t> memo_hits = 0;
+std::atomic<size_t> memo_misses = 0;
+
+// Objective values of one (row/column, level) keyed by the quantized arguments. The radius is clamped as in the
+// objectives, so points beyond the clamp share their value.
+class ObjectiveMemo{
+public:
+    using key_type = std::pair<long long, long long>;
+
+    static key_type key(const std::valarray<double>& args) {
+        return {std::llround(args[0] / QUANTUM), std::llround(std::clamp(args[1], -0.99, 0.99) / QUANTUM)};
+    }
+
+    bool find(const key_type& key, double& value) const {
+        std::lock_guard lock(m_mutex);
+        auto it = std::find_if(m_entries.begin(), m_entries.end(), [&](const auto& entry) { return entry.first == key; });
+        if(it == m_entries.end()) return false;
+        value = it->second;
+        return true;
+    }
+
+    void insert(const key_type& key, double value) {
+        std::lock_guard lock(m_mutex);
+        m_entries.emplace_back(key, value);
+    }
+
+    // keeps the storage for the next level
+    void clear() { m_entries.clear(); }
+
+private:
+    static constexpr double QUANTUM = 1e-9;
+
+    mutable std::mutex m_mutex;
+    std::vector<std::pair<key_type, double>> m_entries;
+};
+
+// Objective consulting the memo first. It borrows the objective, copies own a clone of it but share the memo.
+template<typename Fun>
+class MemoizedFun{
+public:
+    using arg_type = typename Fun::arg_type;
+    using value_type = typename Fun::value_type;
+
+    MemoizedFun(const Fun& fun, ObjectiveMemo& memo) : m_fun(fun), m_memo(&memo) {}
+
+    size_t argc() const { return m_fun->argc(); }
+
+    value_type operator()(const std::valarray<arg_type>& args) const {
+        auto key = ObjectiveMemo::key(args);
+        double value;
+        if(m_memo->find(key, value)){
+            memo_hits++;
+            return value;
+        }
+        memo_misses++;
+        value = (*m_fun)(args);
+        m_memo->insert(key, value);
+        return value;
+    }
+
+private:
+    CloneOnCopy<const Fun> m_fun;
+    ObjectiveMemo* m_memo;
+};
+
+bool contains_point(const std::vector<std::valarray<double>>& points, const std::valarray<double>& point){
+    return std::any_of(points.begin(), points.end(), [&](const std::valarray<double>& p) {
+        return std::abs(p[0] - point[0]) < 1e-9 && std::abs(p[1] - point[1]) < 1e-9;
+    });
+}
+
+template<typename Fun>
+std::valarray<double> hierarchical_sample_point(const Fun& opt_fun, const PolarGrid& grid, size_t threads){
+    double angle_step = std::numbers::pi / static_cast<double>(grid.angles);
+    double radius_step = grid.max_radius / static_cast<double>(grid.radii);
+
+    std::vector<std::valarray<double>> points = {
+        {0, 0},
+    };
+    for(size_t i = 0; i < grid.angles; i++){
+        for(size_t j = 1; j <= grid.radii; j++){
+            points.push_back({angle_step * static_cast<double>(i), radius_step * static_cast<double>(j)});
+        }
+    }
+    std::vector<double> values = evaluate_points(opt_fun, points, threads);
+
+    for(size_t round = 0; round < grid.rounds; round++){
+        angle_step /= 2;
+        radius_step /= 2;
+
+        std::vector<size_t> order(points.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return values[a] < values[b]; });
+
+        // neighbours at half the previous step, the angle wraps around at pi
+        std::vector<std::valarray<double>> candidates;
+        size_t kept = 0;
+        for(size_t idx : order){
+            if(kept == grid.keep) break;
+            if(points[idx][1] == 0) continue;
+            kept++;
+            const std::pair<double, double> shifts[] = {{-angle_step, 0}, {angle_step, 0}, {0, -radius_step}, {0, radius_step}};
+            for(auto [angle_shift, radius_shift] : shifts){
+                double angle = points[idx][0] + angle_shift;
+                if(angle < 0) angle += std::numbers::pi;
+                if(angle >= std::numbers::pi) angle -= std::numbers::pi;
+                std::valarray<double> candidate = {angle, points[idx][1] + radius_shift};
+                if(candidate[1] <= 0 || candidate[1] > 0.98) continue;
+                if(contains_point(points, candidate) || contains_point(candidates, candidate)) continue;
+                candidates.push_back(candidate);
+            }
+        }
+
+        std::vector<double> candidate_values = evaluate_points(opt_fun, candidates, threads);
+        points.insert(points.end(), candidates.begin(), candidates.end());
+        values.insert(values.end(), candidate_values.begin(), candidate_values.end());
+    }
+    return points[first_min(values)];
+}
+
+// Starting point of the Nelder-Mead search, the best of the sample points or of the hierarchical polar grid.
+template<typename Fun>
+std::valarray<double> grid_search(const Fun& opt_fun, const std::vector<std::valarray<double>>& sample_points, const PolarGrid& coarse_grid, GridType grid, size_t threads){
+    if(grid == GridType::HIERARCHICAL) return hierarchical_sample_point(opt_fun, coarse_grid, threads);
+    return sample_points[first_min(evaluate_points(opt_fun, sample_points, threads))];
+}
+
+// Starting simplex size of a warm started level, a neighbour is expected to be closer to the optimum than the grid spacing.
+constexpr double WARM_SHIFT = 0.05;
+// The neighbours are skipped for the grid search if the best of them is this much worse than the zero parameter.
+constexpr double WARM_MARGIN = 1.05;
+
+// (angle, radius) of the `lvl` parameter of the `idx`-th row (column) of the neighbours that have it.
+std::vector<std::valarray<double>> neighbour_points(const WarmStart& warm_start, bool rows, size_t idx, size_t lvl){
+    std::vector<std::valarray<double>> points;
+    for(const CompressedData2D* neighbour : {warm_start.left, warm_start.top, warm_start.channel}){
+        if(neighbour == nullptr) continue;
+        const auto& params = rows ? neighbour->row_params : neighbour->col_params;
+        if(idx < params.size() && lvl < params[idx].size()){
+            points.push_back({Complex::angle(params[idx][lvl]), Complex::abs(params[idx][lvl])});
+        }
+    }
+    return points;
+}
+
+// Radii of the points tried along the descent direction of the spectral start.
+constexpr double SPECTRAL_RADII[] = {0.3, 0.6, 0.9};
+
+// (angle, radius) points along the steepest descent direction of the truncation error estimate at the zero parameter.
+// The gradient is with respect to the square of the parameter, so the angle of the parameter is half of its angle.
+template<typename Fun>
+std::vector<std::valarray<double>> spectral_points(const Fun& opt_fun){
+    std::array<double, 2> gradient;
+    opt_fun.truncation_gradient(Complex(0), gradient);
+    if(gradient[0] == 0 && gradient[1] == 0) return {};
+    double angle = Complex::angle(Complex(-gradient[0], -gradient[1])) / 2;
+    if(angle < 0) angle += std::numbers::pi;
+    std::vector<std::valarray<double>> points;
+    for(double radius : SPECTRAL_RADII) points.push_back({angle, radius});
+    return points;
+}
+
+// Starting point of a level and the size of its starting simplex.
+struct LevelStart{
+    std::valarray<double> origin;
+    double shift;
+};
+
+// Starting point from the best of the zero and the guessed (neighbour or spectral) parameters, from the grid search if
+// the guesses are clearly worse than zero.
+template<typename Fun>
+LevelStart warm_search(const Fun& opt_fun, const std::vector<std::valarray<double>>& guesses, const std::vector<std::valarray<double>>& sample_points, const PolarGrid& coarse_grid, GridType grid, size_t threads){
+    if(!guesses.empty()){
+        std::vector<std::valarray<double>> points = {
+            {0, 0},
+        };
+        points.insert(points.end(), guesses.begin(), guesses.end());
+        std::vector<double> values = evaluate_points(opt_fun, points, threads);
+        size_t best = first_min(values);
+        double guess_best = *std::min_element(values.begin() + 1, values.end());
+        if(guess_best <= values[0] * WARM_MARGIN) return LevelStart{points[best], WARM_SHIFT};
+    }
+    return LevelStart{grid_search(opt_fun, sample_points, coarse_grid, grid, threads), 0.1};
+}
+
+// The starting point is the first vertex of the starting simplex.
+template<typename Fun>
+std::valarray<double> optimize_level(const Fun& opt_fun, const std::valarray<double>& origin, const OptimizerSettings& settings, size_t threads, double shift = 0.1){
+    std::array<std::array<double, 2>, 3> start_points = {{
+        {origin[0], origin[1]},
+        {origin[0] + shift, origin[1]},
+        {origin[0], origin[1] + shift},
+    }};
+
+    FixedNelderMead<Fun, 2> optimizer(opt_fun, 0.001);
+    if(settings.step == StepType::SPECULATIVE) optimizer.set_threads(threads);
+
+    auto result = optimizer.find_min(start_points, settings.max_iterations, settings.max_shrink);
+    return {result[0], result[1]};
+}
+
+// Projected quasi-Newton from `origin` on the square of the level parameter, the result is in the (angle, radius) form
+// of the other searches. The 2D objectives reject radii above 0.98.
+template<typename Fun>
+std::valarray<double> optimize_level_gradient(const Fun& opt_fun, const std::valarray<double>& origin, size_t max_iterations){
+    auto gradient_fun = [&opt_fun](const std::array<double, 2>& x, std::array<double, 2>& gradient) {
+        return opt_fun.truncation_gradient(Complex(x[0], x[1]), gradient);
+    };
+    Complex start = Complex::polar(std::clamp(origin[1], -0.98, 0.98), origin[0]);
+    start *= start;
+
+    ProjectedQuasiNewton<decltype(gradient_fun), 2> optimizer(gradient_fun, 0.98 * 0.98, 0.001);
+
+    auto result = optimizer.find_min({start.real, start.imag}, max_iterations);
+    Complex param = Complex::sqrt(Complex(result[0], result[1]));
+    return {Complex::angle(param), Complex::abs(param)};
+}
+
+// Nelder-Mead on the (memoized) objective or quasi-Newton on the gradient of the truncation error estimate.
+template<typename Fun>
+std::valarray<double> search_level(const Fun& opt_fun, const MemoizedFun<Fun>& memo_fun, const std::valarray<double>& origin, const OptimizerSettings& settings, size_t threads, double shift = 0.1){
+    if(settings.method == OptimizerOpt::QUASI_NEWTON) return optimize_level_gradient(opt_fun, origin, settings.max_iterations);
+    return optimize_level(memo_fun, origin, settings, threads, shift);
+}
+
+bool past_deadline(const OptimizerSettings& settings){
+    return std::chrono::steady_clock::now() >= settings.deadline;
+}
+
+// The quasi-Newton search optimizes the estimate, so its result is checked against the exact error as with the proxy.
+ObjectiveType search_objective(const OptimizerSettings& settings){
+    return settings.method == OptimizerOpt::QUASI_NEWTON ? ObjectiveType::TRANSFORM_PROXY : settings.objective;
+}
+
+// The gradient of the 2D objectives needs the cached transform of the incremental evaluation.
+EvaluationType search_evaluation(const OptimizerSettings& settings){
+    bool gradient = settings.method == OptimizerOpt::QUASI_NEWTON || settings.start == StartType::SPECTRUM;
+    return gradient ? EvaluationType::INCREMENTAL : settings.evaluation;
+}
+
+// Guessed starting points of a level of the 2D search.
+template<typename Fun>
+std::vector<std::valarray<double>> start_points(const Fun& opt_fun, const OptimizerSettings& settings, const WarmStart& warm_start, bool rows, size_t idx, size_t lvl){
+    if(settings.start == StartType::SPECTRUM && warm_start.channel == nullptr) return spectral_points(opt_fun);
+    return neighbour_points(warm_start, rows, idx, lvl);
+}
+
+// Sets the optimized level parameter with `set_param`, with a proxy objective only if it does not increase the exact
+// `error()` of the `previous` one.
+template<typename SetParam, typename ErrorFun>
+void set_level_param(SetParam set_param, const std::valarray<double>& result, BlaschkeFunction::value_type previous, ObjectiveType objective, ErrorFun error){
+    double angle = result[0];
+    double radius = std::clamp(result[1], -0.99, 0.99);
+
+    if(objective == ObjectiveType::EXACT){
+        set_param(Complex::polar(radius, angle));
+        return;
+    }
+
+    set_param(previous);
+    double previous_error = error();
+    set_param(Complex::polar(radius, angle));
+    if(error() > previous_error){
+        set_param(previous);
+    }
+}
+
+template<typename ErrorFun>
+void set_level_param(FunctionSystem& func_sys, size_t lvl, const std::valarray<double>& result, BlaschkeFunction::value_type previous, ObjectiveType objective, ErrorFun error){
+    set_level_param([&](BlaschkeFunction::value_type param) { func_sys.set_function(lvl, param); }, result, previous, objective, error);
+}
+
+}
+
+ObjectiveCacheStats bfft::objective_cache_stats(){
+    return ObjectiveCacheStats{memo_hits, memo_misses};
+}
+
+BlaschkeFFT bfft::optimize_blaschke_fft(const std::vector<BlaschkeFFT::value_type>& data, double ratio, BlaschkeFFT::ResizeType resize_type, const OptimizerSettings& settings, size_t sample_radius, size_t sample_angle){
     std::vector<std::valarray<double>> sample_points = {
         {0, 0},
     };
@@ -54,44 +546,37 @@ BlaschkeFFT bfft::optimize_blaschke_fft(const std::vector<BlaschkeFFT::value_typ
         }
     }
 
+    // at most 13 + 2 * 12 evaluations instead of the 172 of the sample points
+    const PolarGrid coarse_grid{4, 3, 0.9, 3, 2};
+    size_t threads = thread_count(settings.grid_threads);
+
     BlaschkeFFT bfft;
+    auto exact_error = [&]() { return Compressor1D(bfft, ratio, resize_type).compression_error(data); };
+    ObjectiveMemo memo;
     size_t iterations = 1;
     for(size_t iter = 0; iter < iterations; iter++){
         for(size_t lvl = ceil_log2(data.size()); lvl > 0; lvl--){
-            OptimizerFun1D opt_fun(data, bfft, lvl - 1, ratio, resize_type);
-
-            std::valarray<double> origin = sample_points[0];
-            double best_val = opt_fun(origin);
-            for(size_t i = 1; i < sample_points.size(); i++){
-                double tmp = opt_fun(sample_points[i]);
-                if(tmp < best_val){
-                    best_val = tmp;
-                    origin = sample_points[i];
-                }
-            }
-
-
-            std::vector<std::valarray<double>> start_points = {
-                origin,
-                {origin[0] + 0.1, origin[1]},
-                {origin[0], origin[1] + 0.1},
-            };
-            
-            NelderMead<OptimizerFun1D> optimizer(opt_fun, 0.001);
-
-
-            auto result = optimizer.find_min(start_points, max_iterations, max_shrink);
-
-            double angle = result[0];
-            double radius = std::clamp(result[1], -0.99, 0.99);
-
-            bfft.function_system().set_function(lvl - 1, Complex::polar(radius, angle));
+            if(past_deadline(settings)) return bfft;
+            auto previous = bfft.function_system().at(lvl - 1).get_param();
+            memo.clear();
+            OptimizerFun1D opt_fun(data, bfft, lvl - 1, ratio, resize_type, settings.objective);
+            MemoizedFun memo_fun(opt_fun, memo);
+
+            std::vector<std::valarray<double>> guesses;
+            if(settings.start == StartType::SPECTRUM) guesses = spectral_points(opt_fun);
+            auto start = warm_search(memo_fun, guesses, sample_points, coarse_grid, settings.grid, threads);
+            auto result = search_level(opt_fun, memo_fun, start.origin, settings, threads, start.shift);
+
+            set_level_param(bfft.function_system(), lvl - 1, result, previous, search_objective(settings), exact_error);
         }
     }
     return bfft;
 }
 
-BlaschkeFFT2 bfft::optimize_blaschke_fft(const matrix::Matrix<BlaschkeFFT::value_type>& data, double ratio, BlaschkeFFT::ResizeType resize_type, size_t max_iterations, size_t max_shrink){
+namespace {
+
+template<typename View>
+BlaschkeFFT2 optimize_blaschke_fft2(View data, double ratio, BlaschkeFFT::ResizeType resize_type, const OptimizerSettings& settings, const WarmStart& warm_start){
     BlaschkeFFT2 bfft2(data.rows(), data.cols());
 
     std::vector<std::valarray<double>> sample_points = {
@@ -109,66 +594,75 @@ BlaschkeFFT2 bfft::optimize_blaschke_fft(const matrix::Matrix<BlaschkeFFT::value
         }
     }
 
-    for(size_t row = 0; row < data.rows(); row++){
-        for(size_t lvl = 1; lvl <= ceil_log2(data.cols()); lvl++){
-            OptimizerFun2D opt_fun(data, bfft2, row, lvl - 1, OptimizerFun2D::ROW, ratio, resize_type);
-
-            std::valarray<double> origin = sample_points[0];
-            double best_val = opt_fun(origin);
-            for(size_t i = 1; i < sample_points.size(); i++){
-                double tmp = opt_fun(sample_points[i]);
-                if(tmp < best_val){
-                    best_val = tmp;
-                    origin = sample_points[i];
-                }
+    // at most 5 + 4 evaluations instead of 13
+    const PolarGrid coarse_grid{2, 2, 0.9, 1, 1};
+
+    auto exact_error = [&]() { return Compressor2D::compression_error(bfft2, data, ratio, resize_type); };
+    size_t threads = thread_count(settings.grid_threads);
+    ObjectiveMemo memo;
+
+    if(settings.sharing == SharingType::SHARED){
+        // one system for the rows and one for the columns, set on every row (column)
+        for(auto type : {OptimizerFun2D<View>::ROWS, OptimizerFun2D<View>::COLS}){
+            bool rows = type == OptimizerFun2D<View>::ROWS;
+            size_t count = rows ? data.rows() : data.cols();
+            for(size_t lvl = 1; lvl <= ceil_log2(rows ? data.cols() : data.rows()); lvl++){
+                if(past_deadline(settings)) return bfft2;
+                auto previous = (rows ? bfft2.get_row_fft(0) : bfft2.get_col_fft(0)).function_system().at(lvl - 1).get_param();
+                memo.clear();
+                OptimizerFun2D<View> opt_fun(data, bfft2, 0, lvl - 1, type, ratio, resize_type, settings.objective);
+                MemoizedFun memo_fun(opt_fun, memo);
+
+                auto start = warm_search(memo_fun, neighbour_points(warm_start, rows, 0, lvl - 1), sample_points, coarse_grid, settings.grid, threads);
+                auto result = optimize_level(memo_fun, start.origin, settings, threads, start.shift);
+
+                auto set_param = [&](BlaschkeFunction::value_type param) {
+                    for(size_t i = 0; i < count; i++) (rows ? bfft2.get_row_fft(i) : bfft2.get_col_fft(i)).function_system().set_function(lvl - 1, param);
+                };
+                set_level_param(set_param, result, previous, settings.objective, exact_error);
             }
+        }
+        return bfft2;
+    }
 
-            std::vector<std::valarray<double>> start_points = {
-                origin,
-                {origin[0] + 0.1, origin[1]},
-                {origin[0], origin[1] + 0.1},
-            };
-            
-            NelderMead<OptimizerFun2D> optimizer(opt_fun, 0.001);
-
-            auto result = optimizer.find_min(start_points, max_iterations, max_shrink);
+    for(size_t row = 0; row < data.rows(); row++){
+        for(size_t lvl = 1; lvl <= ceil_log2(data.cols()); lvl++){
+            if(past_deadline(settings)) return bfft2;
+            auto previous = bfft2.get_row_fft(row).function_system().at(lvl - 1).get_param();
+            memo.clear();
+            OptimizerFun2D<View> opt_fun(data, bfft2, row, lvl - 1, OptimizerFun2D<View>::ROW, ratio, resize_type, settings.objective, search_evaluation(settings));
+            MemoizedFun memo_fun(opt_fun, memo);
 
-            double angle = result[0];
-            double radius = std::clamp(result[1], -0.99, 0.99);
+            auto start = warm_search(memo_fun, start_points(opt_fun, settings, warm_start, true, row, lvl - 1), sample_points, coarse_grid, settings.grid, threads);
+            auto result = search_level(opt_fun, memo_fun, start.origin, settings, threads, start.shift);
 
-            bfft2.get_row_fft(row).function_system().set_function(lvl - 1, Complex::polar(radius, angle));
+            set_level_param(bfft2.get_row_fft(row).function_system(), lvl - 1, result, previous, search_objective(settings), exact_error);
         }
     }
     for(size_t col = 0; col < data.cols(); col++){
         for(size_t lvl = 1; lvl <= ceil_log2(data.rows()); lvl++){
-            OptimizerFun2D opt_fun(data, bfft2, col, lvl - 1, OptimizerFun2D::OptType::COL, ratio, resize_type);
-
-            std::valarray<double> origin = sample_points[0];
-            double best_val = opt_fun(origin);
-            for(size_t i = 1; i < sample_points.size(); i++){
-                double tmp = opt_fun(sample_points[i]);
-                if(tmp < best_val){
-                    best_val = tmp;
-                    origin = sample_points[i];
-                }
-            }
+            if(past_deadline(settings)) return bfft2;
+            auto previous = bfft2.get_col_fft(col).function_system().at(lvl - 1).get_param();
+            memo.clear();
+            OptimizerFun2D<View> opt_fun(data, bfft2, col, lvl - 1, OptimizerFun2D<View>::OptType::COL, ratio, resize_type, settings.objective, search_evaluation(settings));
+            MemoizedFun memo_fun(opt_fun, memo);
 
-            std::vector<std::valarray<double>> start_points = {
-                origin,
-                {origin[0] + 0.1, origin[1]},
-                {origin[0], origin[1] + 0.1},
-            };
+            auto start = warm_search(memo_fun, start_points(opt_fun, settings, warm_start, false, col, lvl - 1), sample_points, coarse_grid, settings.grid, threads);
+            auto result = search_level(opt_fun, memo_fun, start.origin, settings, threads, start.shift);
 
-            NelderMead<OptimizerFun2D> optimizer(opt_fun, 0.001);
-
-            auto result = optimizer.find_min(start_points, max_iterations, max_shrink);
-
-            double angle = result[0];
-            double radius = std::clamp(result[1], -0.99, 0.99);
-
-            bfft2.get_col_fft(col).function_system().set_function(lvl - 1, Complex::polar(radius, angle));
+            set_level_param(bfft2.get_col_fft(col).function_system(), lvl - 1, result, previous, search_objective(settings), exact_error);
         }
     }
 
     return bfft2;
+}
+
+}
+
+BlaschkeFFT2 bfft::optimize_blaschke_fft(matrix::ConstMatrixView<BlaschkeFFT::value_type> data, double ratio, BlaschkeFFT::ResizeType resize_type, const OptimizerSettings& settings, const WarmStart& warm_start){
+    return optimize_blaschke_fft2(data, ratio, resize_type, settings, warm_start);
+}
+
+BlaschkeFFT2 bfft::optimize_blaschke_fft(matrix::SplitComplexView data, double ratio, BlaschkeFFT::ResizeType resize_type, const OptimizerSettings& settings, const WarmStart& warm_start){
+    return optimize_blaschke_fft2(data, ratio, resize_type, settings, warm_start);
 }
\ No newline at end of file
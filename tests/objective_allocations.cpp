@@ -0,0 +1,134 @@
+// Checks that the optimizer objectives don't allocate per evaluation once their per thread workspaces are warm.
+// Every heap allocation goes through the replaced global operator new below and is counted.
+
+#include "../include/optimizer.h"
+#include "../include/split_complex_matrix.hpp"
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <valarray>
+#include <vector>
+
+namespace {
+
+std::atomic<size_t> allocations = 0;
+
+void* counted_alloc(size_t size, size_t alignment) {
+    allocations++;
+    size = (size + alignment - 1) / alignment * alignment;
+    void* p = alignment <= alignof(std::max_align_t) ? std::malloc(size) : std::aligned_alloc(alignment, size);
+    if(p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+}
+
+void* operator new(size_t size) { return counted_alloc(size == 0 ? 1 : size, alignof(std::max_align_t)); }
+void* operator new[](size_t size) { return counted_alloc(size == 0 ? 1 : size, alignof(std::max_align_t)); }
+void* operator new(size_t size, std::align_val_t alignment) { return counted_alloc(size == 0 ? 1 : size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return counted_alloc(size == 0 ? 1 : size, static_cast<size_t>(alignment)); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+namespace {
+
+constexpr size_t WARM_UP_EVALUATIONS = 4;
+constexpr size_t COUNTED_EVALUATIONS = 16;
+
+// Deterministic test signal, smooth with some noise, so the coefficients don't tie.
+double sample(size_t i, size_t j) {
+    return 50.0 * std::sin(0.3 * static_cast<double>(i) + 0.2 * static_cast<double>(j)) + static_cast<double>((i * 31 + j * 17) % 23);
+}
+
+std::vector<std::valarray<double>> evaluation_points(size_t count) {
+    std::vector<std::valarray<double>> points;
+    for(size_t k = 0; k < count; k++) points.push_back({0.4 * static_cast<double>(k), 0.05 + 0.8 * static_cast<double>(k % 7) / 7.0});
+    return points;
+}
+
+// Allocations of the counted evaluations after the warm-up ones, every point is allocated before counting.
+template<typename Fun>
+size_t count_allocations(const Fun& fun) {
+    auto warm_up = evaluation_points(WARM_UP_EVALUATIONS);
+    auto points = evaluation_points(COUNTED_EVALUATIONS);
+    volatile double sink = 0;
+    for(const auto& point : warm_up) sink = sink + fun(point);
+    size_t before = allocations;
+    for(const auto& point : points) sink = sink + fun(point);
+    return allocations - before;
+}
+
+bool report(const std::string& name, size_t count) {
+    if(count != 0) std::cerr << "FAILED " << name << ": " << count << " allocations in " << COUNTED_EVALUATIONS << " evaluations" << std::endl;
+    return count == 0;
+}
+
+const bfft::BlaschkeFFT::ResizeType RESIZE_TYPES[] = {bfft::BlaschkeFFT::ResizeType::RESIZE, bfft::BlaschkeFFT::ResizeType::LINEAR_INTERPOLATION};
+const bfft::ObjectiveType OBJECTIVES[] = {bfft::ObjectiveType::EXACT, bfft::ObjectiveType::TRANSFORM_PROXY};
+
+bool check_1d(size_t size) {
+    bool ok = true;
+    std::vector<bfft::BlaschkeFFT::value_type> data(size);
+    for(size_t i = 0; i < size; i++) data[i] = Complex(sample(i, 0));
+    for(auto resize_type : RESIZE_TYPES){
+        for(auto objective : OBJECTIVES){
+            bfft::BlaschkeFFT bfft;
+            bfft::OptimizerFun1D fun(data, bfft, bfft::ceil_log2(size) - 1, 0.5, resize_type, objective);
+            ok &= report("1D size " + std::to_string(size), count_allocations(fun));
+        }
+    }
+    return ok;
+}
+
+template<typename View>
+bool check_2d(View data, const std::string& name) {
+    using Fun = bfft::OptimizerFun2D<View>;
+    bool ok = true;
+    const typename Fun::OptType types[] = {Fun::ROW, Fun::COL, Fun::ROWS, Fun::COLS};
+    for(auto type : types){
+        for(auto resize_type : RESIZE_TYPES){
+            for(auto objective : OBJECTIVES){
+                // the shared systems are always evaluated in full
+                bool incremental = type == Fun::ROW || type == Fun::COL;
+                for(auto evaluation : {bfft::EvaluationType::FULL, bfft::EvaluationType::INCREMENTAL}){
+                    if(evaluation == bfft::EvaluationType::INCREMENTAL && !incremental) continue;
+                    bfft::BlaschkeFFT2 bfft2(data.rows(), data.cols());
+                    Fun fun(data, bfft2, 1, 1, type, 0.5, resize_type, objective, evaluation);
+                    ok &= report(name + " type " + std::to_string(type) + " evaluation " + std::to_string(evaluation), count_allocations(fun));
+                }
+            }
+        }
+    }
+    return ok;
+}
+
+bool check_2d(size_t rows, size_t cols) {
+    bfft::matrix::Matrix<Complex> data(rows, cols);
+    for(size_t i = 0; i < rows; i++){
+        for(size_t j = 0; j < cols; j++) data[i][j] = Complex(sample(i, j));
+    }
+    bfft::matrix::SplitComplexMatrix split(data.view());
+    std::string size = std::to_string(rows) + "x" + std::to_string(cols);
+    bool ok = check_2d(bfft::matrix::ConstMatrixView<Complex>(data.view()), "2D " + size);
+    ok &= check_2d(bfft::matrix::SplitComplexView(split.view()), "2D split " + size);
+    return ok;
+}
+
+}
+
+int main() {
+    bool ok = true;
+    for(size_t size : {12, 16, 64}) ok &= check_1d(size);
+    for(size_t size : {12, 16, 64}) ok &= check_2d(size, size);
+    std::cout << (ok ? "Objective evaluations don't allocate." : "Objective evaluations allocate!") << std::endl;
+    return ok ? 0 : 1;
+}